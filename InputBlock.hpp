@@ -1,16 +1,74 @@
 #pragma once
+// 2.0: InputBlock/Option use std::pmr strings and vectors (see README.md)
+#define USERIO_VERSION_MAJOR 2
+#define USERIO_VERSION_MINOR 0
 #include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <charconv>
+#include <chrono>
+#include <condition_variable>
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <exception>
+#include <filesystem>
+#include <functional>
 #include <fstream>
+#include <iomanip>
 #include <iostream>
 #include <istream>
+#include <iterator>
+#include <memory>
+#include <memory_resource>
+#include <mutex>
 #include <optional>
 #include <sstream>
+#include <stdexcept>
 #include <string>
 #include <string_view>
+#include <thread>
+#include <tuple>
+#include <type_traits>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
 #include <vector>
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define USERIO_HAVE_MMAP 1
+#endif
+// Define USERIO_NO_INOTIFY to watch files (InputWatcher) only by polling
+#if defined(__linux__) && !defined(USERIO_NO_INOTIFY)
+#include <poll.h>
+#include <sys/inotify.h>
+#define USERIO_HAVE_INOTIFY 1
+#endif
+// Define USERIO_NO_SIMD to use only the portable (scalar) input scanner
+#if !defined(USERIO_NO_SIMD) && (defined(__SSE2__) || defined(_M_X64))
+#include <immintrin.h>
+#define USERIO_HAVE_SSE2 1
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+// AVX2 kernel compiled regardless of -m flags; used if the CPU supports it
+#define USERIO_HAVE_AVX2 1
+#endif
+#endif
 
 namespace UserIO {
 
+namespace detail {
+#if defined(__cpp_lib_to_chars)
+constexpr bool defined_from_chars_fp = true;
+#else
+constexpr bool defined_from_chars_fp = false;
+#endif
+} // namespace detail
+
 //******************************************************************************
 //! Removes all white space (space, tab, newline), AND quote marks!
 inline std::string removeSpaces(std::string lines);
@@ -21,12 +79,326 @@ inline void removeBlockComments(std::string &input);
 //! Removes all c++ style comments from a string (block and line)
 inline std::string removeComments(const std::string &input);
 
-//! Parses a string to type T by stringstream
-template <typename T> inline T parse_str_to_T(const std::string &value_as_str);
+//******************************************************************************
+namespace detail {
+//! Characters that can change the lexer's state: white space, quotes, comment
+//! starts (and '*', for block comment ends), ';', '{' and '}'. All others are
+//! part of a key/value (or comment), so can be copied/skipped in bulk
+constexpr char special_chars[] = {' ', '\t', '\n', '\'', '\"', '!',
+                                  '#', '/',  ';',  '{',  '}',  '*'};
+
+//! Bit i set if p[i] is a special character. n<=64.
+//! special_mask64: exactly 64 bytes, using SIMD where available (AVX2 selected
+//! at runtime, else SSE2); special_mask_scalar: lookup table, for any n.
+inline std::uint64_t special_mask64(const char *p);
+inline std::uint64_t special_mask_scalar(const char *p, std::size_t n);
+
+//! Finds each special character in text in turn. Mask is built for 64 bytes at
+//! a time, and then consumed until the scan moves past that block
+class SpecialScanner {
+public:
+  explicit SpecialScanner(std::string_view text) : m_text(text) {}
+  //! Position of first special character at or after i (text.size() if none)
+  inline std::size_t next(std::size_t i);
+
+private:
+  std::string_view m_text;
+  std::size_t m_block{std::string_view::npos}; // start of block in m_mask
+  std::uint64_t m_mask{0};
+};
+} // namespace detail
+
+//******************************************************************************
+//! Single-pass lexer for the Block{option=value;} format. Comments (//, #, !
+//! and /* */), white space and quote marks are stripped on the fly, and each
+//! option/block is passed to 'handler' as soon as it is complete:
+//!   handler.on_option(key, value);
+//!   handler.on_block_begin(name);
+//!   handler.on_block_end();
+//! Input may be fed in any number of chunks; state is kept between calls.
+//! No intermediate copies of the input are made. Runs of ordinary characters
+//! are located 64 bytes at a time (see detail::SpecialScanner) and copied in bulk.
+//! Braces are matched using an explicit stack, so nesting depth is unlimited.
+//! Unbalanced braces are reported (with line:column) to std::cerr (see
+//! setErrorStream): an unmatched '}' is ignored, and any blocks still open at finish() are closed.
+//! This is also the event-driven (SAX-style) interface: use it (or
+//! parse_input) with your own Handler to read input without building an
+//! InputBlock. key/value/name views are only valid during the callback.
+//! Any callback may return bool instead of void: returning false stops the
+//! lexer (no further callbacks; rest of input is ignored).
+template <typename Handler> class Lexer {
+public:
+  //! line/column: location of start of input (used in error messages), e.g.,
+  //! when lexing a section of a larger input
+  explicit Lexer(Handler &handler, std::size_t line = 1,
+                 std::size_t column = 1)
+      : m_handler(handler),
+        m_offset(column - 1),
+        m_origin(column - 1),
+        m_line(line) {}
+
+  //! Lex the next piece of input
+  inline void feed(std::string_view chunk);
+  //! Signals end of input. Any trailing option without a ';' is discarded
+  inline void finish();
+
+  //! Number of blocks currently open
+  std::size_t depth() const { return m_open.size(); }
+  //! True if a handler callback returned false
+  bool stopped() const { return m_stopped; }
+
+  //! Call from on_block_begin: contents of the block just opened are skipped
+  //! (no callbacks) up to its matching '}' (then on_block_end is called as
+  //! normal). Only braces and comments are tracked while skipping, so this is
+  //! much cheaper than lexing the contents
+  void skipBlock() { m_skip = 1; }
+
+  //! Unbalanced braces are reported to os instead of std::cerr
+  void setErrorStream(std::ostream &os) { m_errors = &os; }
+
+  struct Position {
+    std::size_t offset; // bytes from start of input
+    std::size_t line, column;
+  };
+  //! Position of the brace currently being handled (from on_block_begin or
+  //! on_block_end); end of input during finish()
+  Position position() const {
+    return {m_at - m_origin, m_line, m_at - m_line_start + 1};
+  }
+
+private:
+  enum class State { Normal, Slash, LineComment, BlockComment, BlockStar };
+  struct Location {
+    std::size_t line, column;
+  };
+  Handler &m_handler;
+  State m_state{State::Normal};
+  std::string m_token{}; // current token, with spaces/quotes already removed
+  std::vector<Location> m_open{}; // Location of each currently open '{'
+  std::size_t m_offset{0}; // bytes lexed before current chunk (+column-1)
+  std::size_t m_origin{0}; // column-1 of start of input
+  std::size_t m_at{0};     // offset of brace being handled (see position())
+  std::size_t m_line{1};
+  std::size_t m_line_start{0}; // offset of first char on current line
+  bool m_stopped{false};
+  std::size_t m_skip{0}; // depth of braces within skipped block (0: none)
+  std::ostream *m_errors{&std::cerr};
+
+  inline void emit_option();
+  // Calls handler callback; callbacks may return void or bool (false=stop)
+  template <typename F> void notify(F &&callback);
+};
+
+//! Lexes input (read in chunks of chunk_size bytes), passing each
+//! option/block to handler as for Lexer; the input is never stored as a
+//! whole, so memory use is constant. Returns false if handler stopped early.
+template <typename Handler>
+bool parse_input(const std::istream &input, Handler &handler,
+                 std::size_t chunk_size = 1 << 16);
+//! As above, for input already in memory
+template <typename Handler>
+bool parse_input(std::string_view input, Handler &handler);
+
+//! Parses a string to type T. Fast path (std::from_chars) for numbers; other
+//! types by stringstream. Lenient: like stringstream, parses leading part of
+//! string (e.g., "1.5abc" -> 1.5); returns T{} if it cannot be parsed at all
+template <typename T> inline T parse_str_to_T(std::string_view value_as_str);
+
+//! Strict version of parse_str_to_T: entire string must be a valid T, else
+//! returns empty optional. For bool: true/false, yes/no, y/n, 1/0
+template <typename T>
+inline std::optional<T> try_parse_str_to_T(std::string_view value_as_str);
 
-//! Parses entire file into string. Note: v. inefficient
+//! Parses entire file into string (one copy). Prefer InputBlock::fromFile
 inline std::string file_to_string(const std::istream &file);
 
+//! Reads entire file into a string (a copy: unaffected by later changes to
+//! the file). Also works for pipes, FIFOs, /dev/stdin, etc. Empty optional if
+//! file could not be opened
+inline std::optional<std::string> read_file(const std::string &filename);
+
+//******************************************************************************
+//! Statistics for one phase of a parse, passed to ParseTracer::onPhase.
+//! Phases: "read" (file read/mapped), "parse" (lexing + building the tree;
+//! comments and spaces are stripped in the same pass), "parse_sections" (as
+//! parse, on several threads), "join" (results of parse_sections combined),
+//! "consolidate" (blocks of the same name merged) and "materialize" (a lazy
+//! block parsed on first access; see fromFileLazy).
+struct ParsePhase {
+  const char *name{""};
+  double seconds{0.0};        // wall time
+  std::size_t bytes_in{0};    // input bytes read/lexed
+  std::size_t bytes_out{0};   // bytes copied into memory (read phase)
+  std::size_t nodes_in{0};    // options + blocks in the tree before the phase
+  std::size_t nodes_out{0};   // ... and after
+  std::size_t memory{0};      // approx. heap memory held by the result (bytes)
+};
+
+//! Receives ParsePhase statistics. The default implementation does nothing;
+//! override onPhase (e.g., StreamTracer), and install with ScopedParseTracer.
+//! If one tracer is installed on several threads, onPhase must be thread-safe
+class ParseTracer {
+public:
+  virtual ~ParseTracer() = default;
+  //! Called at the end of each phase
+  virtual void onPhase(const ParsePhase &) {}
+};
+
+//! Writes each phase to a stream, as a line of text or as one JSON object per
+//! line (e.g., to collect from production runs)
+class StreamTracer final : public ParseTracer {
+public:
+  enum class Format { Text, Json };
+  explicit StreamTracer(std::ostream &os, Format format = Format::Text)
+      : m_os(os), m_format(format) {}
+  inline void onPhase(const ParsePhase &phase) override;
+
+private:
+  std::ostream &m_os;
+  Format m_format;
+  std::mutex m_mutex{};
+};
+
+namespace detail {
+// Tracer for parses on this thread (none by default)
+inline ParseTracer *&current_tracer() {
+  static thread_local ParseTracer *tracer = nullptr;
+  return tracer;
+}
+} // namespace detail
+
+//! Installs tracer for all parses on the current thread (parses on other
+//! threads, e.g., by InputBlock::addParallel, are traced as a single phase)
+//! until destroyed; the previous tracer is then restored
+class ScopedParseTracer {
+public:
+  explicit ScopedParseTracer(ParseTracer &tracer)
+      : m_previous(std::exchange(detail::current_tracer(), &tracer)) {}
+  ~ScopedParseTracer() { detail::current_tracer() = m_previous; }
+  ScopedParseTracer(const ScopedParseTracer &) = delete;
+  ScopedParseTracer &operator=(const ScopedParseTracer &) = delete;
+
+private:
+  ParseTracer *m_previous;
+};
+
+namespace detail {
+// Size of a tree (see ParsePhase)
+struct TreeStats {
+  std::size_t nodes{0}, memory{0};
+};
+// Times one phase, if a tracer is installed (otherwise does nothing, and
+// 'stats' is never called). stats() gives the TreeStats of the result; it is
+// called at the start and end of the phase (outside of the timing)
+template <typename Stats> class PhaseTrace {
+public:
+  PhaseTrace(const char *name, std::size_t bytes_in, Stats stats)
+      : m_tracer(current_tracer()), m_stats(std::move(stats)) {
+    if (!m_tracer)
+      return;
+    m_phase.name = name;
+    m_phase.bytes_in = bytes_in;
+    m_phase.nodes_in = m_stats().nodes;
+    m_start = std::chrono::steady_clock::now();
+  }
+  ~PhaseTrace() {
+    if (!m_tracer)
+      return;
+    m_phase.seconds = std::chrono::duration<double>(
+                          std::chrono::steady_clock::now() - m_start)
+                          .count();
+    const auto stats = m_stats();
+    m_phase.nodes_out = stats.nodes;
+    m_phase.memory = std::max(m_phase.memory, stats.memory);
+    m_tracer->onPhase(m_phase);
+  }
+  PhaseTrace(const PhaseTrace &) = delete;
+  PhaseTrace &operator=(const PhaseTrace &) = delete;
+
+  void setBytesIn(std::size_t bytes) { m_phase.bytes_in = bytes; }
+  void setBytesOut(std::size_t bytes) { m_phase.bytes_out = bytes; }
+  void setMemory(std::size_t bytes) { m_phase.memory = bytes; }
+
+private:
+  ParseTracer *m_tracer;
+  Stats m_stats;
+  ParsePhase m_phase{};
+  std::chrono::steady_clock::time_point m_start{};
+};
+} // namespace detail
+
+//******************************************************************************
+//! Read-only view of an entire file. Regular files are memory-mapped where
+//! available (POSIX), so the file is never copied; otherwise (or for pipes
+//! etc.), read into memory (see read_file).
+//! Evaluates to false if file could not be opened.
+class MappedFile {
+public:
+  explicit MappedFile(const std::string &filename) { open(filename); }
+  ~MappedFile() { close(); }
+  MappedFile(const MappedFile &) = delete;
+  MappedFile &operator=(const MappedFile &) = delete;
+
+  //! Entire contents of the file
+  std::string_view view() const { return {m_data, m_size}; }
+  explicit operator bool() const { return m_ok; }
+
+private:
+  const char *m_data{nullptr};
+  std::size_t m_size{0};
+  bool m_ok{false};
+  bool m_mapped{false};
+  std::string m_buffer{}; // only used if file cannot be mapped
+
+  inline void open(const std::string &filename);
+  inline void close();
+};
+
+//******************************************************************************
+namespace detail {
+// Worker threads shared by all parallel parsing: one per core, less one for
+// the calling thread (created on first use). Callers take part in their own
+// work, so concurrent (or nested) callers never multiply the number of
+// threads, and never wait for a busy pool
+class ThreadPool {
+public:
+  static inline ThreadPool &shared();
+  inline explicit ThreadPool(unsigned num_workers);
+  inline ~ThreadPool();
+  ThreadPool(const ThreadPool &) = delete;
+  ThreadPool &operator=(const ThreadPool &) = delete;
+
+  // Calls task(i) for each i in [0, n), on at most max_threads threads
+  // (including the caller), and returns once all have finished. An exception
+  // from one task does not stop the others: the first (lowest i) is rethrown
+  // once all have finished
+  template <typename Task>
+  void run(std::size_t n, unsigned max_threads, Task &&task);
+  // Most threads a run can use (workers, plus the caller)
+  unsigned size() const { return unsigned(m_workers.size()) + 1; }
+
+private:
+  inline void work();
+
+  std::vector<std::thread> m_workers{};
+  std::mutex m_mutex{};
+  std::condition_variable m_wake{};
+  std::deque<std::function<void()>> m_jobs{};
+  bool m_stop{false};
+};
+
+// Section of input text, and its location (for error messages)
+struct Section {
+  std::string_view text;
+  std::size_t line, column;
+};
+//! Splits text into sections (each at least min_size bytes, except last),
+//! only at top-level boundaries: just after a ';' or '}' at brace depth 0,
+//! outside of comments. Each section can be parsed independently
+inline std::vector<Section> split_top_level(std::string_view text,
+                                            std::size_t min_size);
+} // namespace detail
+
 //! Class to determine if a class template in vector
 template <typename T> struct IsVector {
   constexpr static bool v = false;
@@ -43,26 +415,402 @@ template <typename T> struct IsVector<std::vector<T>> {
 // std::cout << IO::IsVector<std::vector<int>>::v << "\n";
 // std::cout << IO::IsVector<std::vector<double>>::v << "\n";
 
+//! Number of elements in comma-separated list (0 if blank)
+inline std::size_t list_size(std::string_view list);
+
+//! Parses comma-separated list into 'out' (which must have room for
+//! list_size(list) elements). Very long lists (>= parallel_list_threshold
+//! bytes) are split and parsed on multiple threads (a pool shared by all
+//! callers; see detail::ThreadPool). Returns false if strict and any element
+//! is not a valid T (see try_parse_str_to_T); exceptions from parsing any
+//! element (e.g., T's operator>>) are passed on to the caller
+template <typename T>
+bool parse_list(std::string_view list, T *out, bool strict = false);
+//! As above, but resizes 'out' (memory is re-used)
+template <typename T>
+bool parse_list(std::string_view list, std::vector<T> &out,
+                bool strict = false);
+constexpr std::size_t parallel_list_threshold = 1 << 20;
+
+//! Converts an option's value string to type T (as used by get<T>). Returns
+//! empty optional if value is blank or "default". T may be std::vector, for
+//! comma-separated list input (empty only if value is blank).
+//! strict: also returns empty optional if value (or any list element) is not
+//! a valid T (see try_parse_str_to_T)
+template <typename T>
+std::optional<T> parse_value(std::string_view value_str, bool strict = false);
+
 //******************************************************************************
-//! Simple struct; holds key-value pair, both strings. == compares key
+//! Simple struct; holds key-value pair, both strings. == compares key.
+//! Allocator-aware: in an InputBlock, strings use the block's memory resource
 struct Option {
-  std::string key;
-  std::string value_str;
+  using allocator_type = std::pmr::polymorphic_allocator<char>;
+  std::pmr::string key{};
+  std::pmr::string value_str{};
+
+  Option() = default;
+  Option(std::string_view tkey, std::string_view tvalue_str,
+         const allocator_type &alloc = {})
+      : key(tkey, alloc), value_str(tvalue_str, alloc) {}
+  Option(const Option &) = default;
+  Option(Option &&) noexcept = default;
+  Option &operator=(const Option &) = default;
+  Option &operator=(Option &&) = default;
+  Option(const Option &other, const allocator_type &alloc)
+      : key(other.key, alloc), value_str(other.value_str, alloc) {}
+  Option(Option &&other, const allocator_type &alloc)
+      : key(std::move(other.key), alloc),
+        value_str(std::move(other.value_str), alloc) {}
 
-  friend bool operator==(Option option, std::string_view tkey) {
+  friend bool operator==(const Option &option, std::string_view tkey) {
     return option.key == tkey;
   }
-  friend bool operator==(std::string_view tkey, Option option) {
+  friend bool operator==(std::string_view tkey, const Option &option) {
     return option == tkey;
   }
-  friend bool operator!=(Option option, std::string_view tkey) {
+  friend bool operator!=(const Option &option, std::string_view tkey) {
     return !(option == tkey);
   }
-  friend bool operator!=(std::string_view tkey, Option option) {
+  friend bool operator!=(std::string_view tkey, const Option &option) {
     return !(option == tkey);
   }
 };
 
+//******************************************************************************
+//! Hash index over a list of named entries (e.g., options or blocks): maps each
+//! key to the position of the *last* entry with that key, so later entries
+//! override earlier ones. Only positions are stored (keys are read back from
+//! the list via key_of(pos)), so it stays valid if the list is reallocated or
+//! copied. Open addressing, linear probing, load factor <= 1/2.
+class KeyIndex {
+public:
+  KeyIndex() = default;
+  explicit KeyIndex(std::pmr::memory_resource *resource) : m_slots(resource) {}
+
+  //! Index entries [0, size) of the list
+  template <typename KeyOf> void build(std::size_t size, KeyOf key_of);
+  //! Index a new entry at position 'pos' (which must be after all others).
+  //! Positions are 32-bit: throws std::length_error if pos >= 2^32 - 1
+  template <typename KeyOf> void insert(std::size_t pos, KeyOf key_of);
+  //! Position of last entry with key, or empty if not found
+  template <typename KeyOf>
+  std::optional<std::size_t> find(std::string_view key, KeyOf key_of) const;
+
+  bool empty() const { return m_slots.empty(); }
+  void clear() {
+    m_slots.clear();
+    m_count = 0;
+  }
+
+private:
+  struct Slot {
+    std::uint32_t hash{0};
+    std::uint32_t pos_plus1{0}; // 0 => empty slot
+  };
+  std::pmr::vector<Slot> m_slots{};
+  std::size_t m_count{0};
+
+  static std::uint32_t hash(std::string_view key) {
+    return std::uint32_t(std::hash<std::string_view>{}(key));
+  }
+};
+
+//******************************************************************************
+//! Identifies the current state of an InputBlock: changes each time the block
+//! is modified or assigned to. Used to detect stale InputBlock::Key handles
+class Version {
+public:
+  Version() = default;
+  Version(const Version &) noexcept {}
+  Version &operator=(const Version &) noexcept {
+    bump();
+    return *this;
+  }
+  void bump() { ++m_id; }
+  std::uint64_t id() const { return m_id; }
+
+private:
+  std::uint64_t m_id{0};
+};
+
+//******************************************************************************
+namespace detail {
+// Types that may be stored in a ValueCache
+using CacheTypes = std::tuple<bool, short, unsigned short, int, unsigned, long,
+                              unsigned long, long long, unsigned long long,
+                              float, double>;
+// Unique non-zero id for each of CacheTypes, 0 for any other type
+template <typename T, std::size_t... I>
+constexpr std::uint32_t cache_tag(std::index_sequence<I...>) {
+  std::uint32_t tag = 0;
+  ((tag = std::is_same_v<T, std::tuple_element_t<I, CacheTypes>>
+              ? std::uint32_t(I + 1)
+              : tag),
+   ...);
+  return tag;
+}
+} // namespace detail
+
+//! Caches the parsed value of one option, so repeated get<T> calls do not
+//! re-parse the string. Only for arithmetic types (stored as raw bits). Holds
+//! one type at a time: the first type stored is kept. Lock-free, and safe for
+//! concurrent readers: a value is only visible once completely written.
+class ValueCache {
+public:
+  //! True if values of type T can be cached
+  template <typename T>
+  static constexpr bool cacheable =
+      detail::cache_tag<T>(
+          std::make_index_sequence<std::tuple_size_v<detail::CacheTypes>>{}) != 0;
+
+  ValueCache() = default;
+  ValueCache(const ValueCache &other) noexcept { *this = other; }
+  ValueCache &operator=(const ValueCache &other) noexcept {
+    const auto tag = other.m_tag.load(std::memory_order_acquire);
+    m_bits.store(other.m_bits.load(std::memory_order_relaxed),
+                 std::memory_order_relaxed);
+    m_tag.store(tag == busy ? 0 : tag, std::memory_order_release);
+    return *this;
+  }
+
+  //! Cached value, if a value of type T has been stored
+  template <typename T> std::optional<T> load() const {
+    if (m_tag.load(std::memory_order_acquire) != tag<T>())
+      return std::nullopt;
+    const auto bits = m_bits.load(std::memory_order_relaxed);
+    T value;
+    std::memcpy(&value, &bits, sizeof(T));
+    return value;
+  }
+  //! Stores value, unless a value is already stored
+  template <typename T> void store(T value) const {
+    auto expected = std::uint32_t{0};
+    if (!m_tag.compare_exchange_strong(expected, busy,
+                                       std::memory_order_acquire))
+      return;
+    std::uint64_t bits{0};
+    std::memcpy(&bits, &value, sizeof(T));
+    m_bits.store(bits, std::memory_order_relaxed);
+    m_tag.store(tag<T>(), std::memory_order_release);
+  }
+
+private:
+  static constexpr std::uint32_t busy = std::uint32_t(-1);
+  template <typename T> static constexpr std::uint32_t tag() {
+    return detail::cache_tag<T>(
+        std::make_index_sequence<std::tuple_size_v<detail::CacheTypes>>{});
+  }
+
+  mutable std::atomic<std::uint32_t> m_tag{0};
+  mutable std::atomic<std::uint64_t> m_bits{0};
+};
+
+#if defined(USERIO_TELEMETRY)
+//******************************************************************************
+namespace detail {
+//! Access counts for one InputBlock; only with USERIO_TELEMETRY defined
+//! (otherwise, no counting code is compiled). Found options/blocks are
+//! counted with relaxed atomics; look-ups of missing keys (i.e., where the
+//! default value was used) are counted by name, under a mutex.
+//! Copies keep the counts; counts for options are reset by reindex()
+class Telemetry {
+public:
+  Telemetry() = default;
+  Telemetry(const Telemetry &other) { *this = other; }
+  Telemetry &operator=(const Telemetry &other) {
+    if (this == &other)
+      return *this;
+    m_options = other.m_options;
+    m_block_hits.store(other.m_block_hits.load(std::memory_order_relaxed),
+                       std::memory_order_relaxed);
+    std::scoped_lock lock(m_mutex, other.m_mutex);
+    m_missed_options = other.m_missed_options;
+    m_missed_blocks = other.m_missed_blocks;
+    return *this;
+  }
+  Telemetry(Telemetry &&other) noexcept { *this = std::move(other); }
+  Telemetry &operator=(Telemetry &&other) noexcept {
+    m_options = std::move(other.m_options);
+    m_block_hits.store(other.m_block_hits.load(std::memory_order_relaxed),
+                       std::memory_order_relaxed);
+    m_missed_options = std::move(other.m_missed_options);
+    m_missed_blocks = std::move(other.m_missed_blocks);
+    return *this;
+  }
+
+  struct Counter {
+    Counter() = default;
+    Counter(const Counter &other) noexcept { *this = other; }
+    Counter &operator=(const Counter &other) noexcept {
+      hits.store(other.hits.load(std::memory_order_relaxed),
+                 std::memory_order_relaxed);
+      parse_ns.store(other.parse_ns.load(std::memory_order_relaxed),
+                     std::memory_order_relaxed);
+      return *this;
+    }
+    mutable std::atomic<std::uint64_t> hits{0};
+    mutable std::atomic<std::uint64_t> parse_ns{0}; // time spent parsing
+  };
+
+  // Keeps one counter per option
+  void add_option() { m_options.emplace_back(); }
+  void reset_options(std::size_t num_options) {
+    m_options.assign(num_options, Counter{});
+  }
+
+  void hit_option(std::size_t i) const {
+    m_options[i].hits.fetch_add(1, std::memory_order_relaxed);
+  }
+  void add_parse_time(std::size_t i, std::uint64_t ns) const {
+    m_options[i].parse_ns.fetch_add(ns, std::memory_order_relaxed);
+  }
+  void hit_block() const {
+    m_block_hits.fetch_add(1, std::memory_order_relaxed);
+  }
+  void miss_option(std::string_view key) const {
+    std::lock_guard lock(m_mutex);
+    ++m_missed_options[std::string(key)];
+  }
+  void miss_block(std::string_view name) const {
+    std::lock_guard lock(m_mutex);
+    ++m_missed_blocks[std::string(name)];
+  }
+
+  const Counter &option(std::size_t i) const { return m_options[i]; }
+  std::uint64_t block_hits() const {
+    return m_block_hits.load(std::memory_order_relaxed);
+  }
+  // {name, count}, sorted by name
+  std::vector<std::pair<std::string, std::uint64_t>> missed_options() const {
+    std::lock_guard lock(m_mutex);
+    return sorted(m_missed_options);
+  }
+  std::vector<std::pair<std::string, std::uint64_t>> missed_blocks() const {
+    std::lock_guard lock(m_mutex);
+    return sorted(m_missed_blocks);
+  }
+
+private:
+  using Counts = std::unordered_map<std::string, std::uint64_t>;
+  static std::vector<std::pair<std::string, std::uint64_t>>
+  sorted(const Counts &counts) {
+    std::vector<std::pair<std::string, std::uint64_t>> out(counts.begin(),
+                                                           counts.end());
+    std::sort(out.begin(), out.end());
+    return out;
+  }
+
+  std::vector<Counter> m_options{};
+  mutable std::atomic<std::uint64_t> m_block_hits{0};
+  mutable std::mutex m_mutex{};
+  mutable Counts m_missed_options{};
+  mutable Counts m_missed_blocks{};
+};
+} // namespace detail
+#endif
+
+//******************************************************************************
+namespace detail {
+// Buffer for InputBlock::serialize: handed to sink, and cleared, whenever it
+// reaches chunk_size (and once more at the end)
+template <typename Sink> class ChunkedOutput {
+public:
+  ChunkedOutput(Sink &sink, std::size_t chunk_size)
+      : m_sink(sink), m_chunk_size(std::max<std::size_t>(chunk_size, 1)) {
+    m_buffer.reserve(m_chunk_size);
+  }
+  void append(std::string_view text) {
+    if (m_buffer.size() + text.size() > m_chunk_size)
+      flush();
+    if (text.size() >= m_chunk_size)
+      m_sink(text);
+    else
+      m_buffer.append(text);
+  }
+  void push_back(char c) {
+    if (m_buffer.size() == m_chunk_size)
+      flush();
+    m_buffer.push_back(c);
+  }
+  void flush() {
+    if (!m_buffer.empty())
+      m_sink(std::string_view(m_buffer));
+    m_buffer.clear();
+  }
+
+private:
+  Sink &m_sink;
+  std::size_t m_chunk_size;
+  std::string m_buffer{};
+};
+} // namespace detail
+
+//******************************************************************************
+namespace detail {
+// Final step of SplitMix64: spreads every input bit over the output
+inline std::uint64_t mix64(std::uint64_t x) {
+  x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+  x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+  return x ^ (x >> 31);
+}
+// Contribution of the i-th element (with hash h) to an order-dependent sum
+inline std::uint64_t hash_at(std::size_t i, std::uint64_t h) {
+  return mix64(h + (std::uint64_t(i) + 1) * 0x9e3779b97f4a7c15ull);
+}
+
+// Memoized parts of an InputBlock's structural hash: sums of hash_at over its
+// options and over its sub-blocks. Sums, so that appending (or replacing) one
+// entry is O(1). Computed on first use (InputBlock::hash), then kept current;
+// invalid until then, and after any other change. Concurrent readers may both
+// compute it: they store the same values
+class TreeHash {
+public:
+  TreeHash() = default;
+  TreeHash(const TreeHash &other) noexcept { *this = other; }
+  TreeHash &operator=(const TreeHash &other) noexcept {
+    const auto valid = other.m_valid.load(std::memory_order_acquire);
+    m_options.store(other.m_options.load(std::memory_order_relaxed),
+                    std::memory_order_relaxed);
+    m_blocks.store(other.m_blocks.load(std::memory_order_relaxed),
+                   std::memory_order_relaxed);
+    m_valid.store(valid, std::memory_order_release);
+    return *this;
+  }
+
+  bool valid() const { return m_valid.load(std::memory_order_acquire); }
+  std::uint64_t options() const {
+    return m_options.load(std::memory_order_relaxed);
+  }
+  std::uint64_t blocks() const {
+    return m_blocks.load(std::memory_order_relaxed);
+  }
+  void set(std::uint64_t options, std::uint64_t blocks) const {
+    m_options.store(options, std::memory_order_relaxed);
+    m_blocks.store(blocks, std::memory_order_relaxed);
+    m_valid.store(true, std::memory_order_release);
+  }
+  void invalidate() { m_valid.store(false, std::memory_order_relaxed); }
+
+  // nb: only called while valid (and with no concurrent readers)
+  void add_option(std::size_t i, std::uint64_t h) {
+    m_options.store(options() + hash_at(i, h), std::memory_order_relaxed);
+  }
+  void add_block(std::size_t i, std::uint64_t h) {
+    m_blocks.store(blocks() + hash_at(i, h), std::memory_order_relaxed);
+  }
+  void replace_block(std::size_t i, std::uint64_t old_h, std::uint64_t h) {
+    m_blocks.store(blocks() - hash_at(i, old_h) + hash_at(i, h),
+                   std::memory_order_relaxed);
+  }
+
+private:
+  mutable std::atomic<std::uint64_t> m_options{0}, m_blocks{0};
+  mutable std::atomic<bool> m_valid{false};
+};
+} // namespace detail
+
+class Schema;
+
 //******************************************************************************
 //! Holds list of Options, and a list of other InputBlocks. Can be initialised
 //! with a list of options, with a string, or from a file (ifstream).
@@ -81,48 +829,188 @@ struct Option {
 // works as a single-file header-only
 class InputBlock {
 private:
-  std::string m_name{};
-  std::vector<Option> m_options{};
-  std::vector<InputBlock> m_blocks{};
+  // Unparsed body of a lazily-parsed block (see fromFileLazy)
+  struct LazyBody {
+    std::shared_ptr<const void> source; // owns the text
+    std::string_view text;
+    std::size_t line, column; // location of text in input
+    std::once_flag once{};
+    std::atomic<bool> parsed{false};
+  };
+
+  // nb: all containers use the same memory resource (see allocator_type)
+  std::pmr::string m_name{};
+  // nb: mutable, since filled on first access if block is lazy
+  mutable std::pmr::vector<Option> m_options{};
+  mutable std::pmr::vector<InputBlock> m_blocks{};
+  // Hash lookup of m_options/m_blocks; only built once there are more than
+  // index_threshold entries (linear search is faster for short lists)
+  mutable KeyIndex m_option_index{};
+  mutable KeyIndex m_block_index{};
+  static constexpr std::size_t index_threshold = 16;
+  // Parsed value of each option (same size as m_options)
+  mutable std::pmr::vector<ValueCache> m_cache{};
+  Version m_version{};
+  detail::TreeHash m_hash{};
+  std::unique_ptr<LazyBody> m_lazy{};
+#if defined(USERIO_TELEMETRY)
+  mutable detail::Telemetry m_telemetry{};
+#endif
 
 public:
+  //! All memory of the tree (names, options, and sub-blocks, which use their
+  //! parent's) comes from one std::pmr::memory_resource, e.g., a
+  //! std::pmr::monotonic_buffer_resource, so that an entire tree can be
+  //! released at once. Constructors take it as an optional last argument (a
+  //! memory_resource* converts to allocator_type); default: the default
+  //! resource. Blocks/options added from another resource are copied into it
+  using allocator_type = std::pmr::polymorphic_allocator<char>;
+
   //! Default constructor: name will be blank
   InputBlock(){};
+  explicit InputBlock(const allocator_type &alloc)
+      : m_name(alloc),
+        m_options(alloc),
+        m_blocks(alloc),
+        m_option_index(alloc.resource()),
+        m_block_index(alloc.resource()),
+        m_cache(alloc) {}
+
+  //! Copying a block that has not yet been parsed (see fromFileLazy) copies
+  //! only its location in the input; it is parsed separately when accessed.
+  //! nb: copies use the default memory resource (or alloc); moves keep other's
+  InputBlock(const InputBlock &other) { *this = other; }
+  InputBlock(const InputBlock &other, const allocator_type &alloc)
+      : InputBlock(alloc) {
+    *this = other;
+  }
+  inline InputBlock &operator=(const InputBlock &other);
+  InputBlock(InputBlock &&) noexcept = default;
+  InputBlock(InputBlock &&other, const allocator_type &alloc)
+      : InputBlock(alloc) {
+    *this = std::move(other);
+  }
+  //! nb: if memory resources differ, contents are moved element-wise into
+  //! this block's (as for InputTree)
+  InputBlock &operator=(InputBlock &&) noexcept = default;
 
   //! Construct from literal list of 'Options' (see Option struct)
-  InputBlock(std::string_view name, std::initializer_list<Option> options = {})
-      : m_name(name), m_options(options) {}
+  InputBlock(std::string_view name, std::initializer_list<Option> options = {},
+             const allocator_type &alloc = {})
+      : InputBlock(alloc) {
+    m_name = name;
+    m_options = options;
+    reindex();
+  }
 
   //! Construct from a string with the correct Block{option=value;} format
-  InputBlock(std::string_view name, const std::string &string_input)
-      : m_name(name) {
+  InputBlock(std::string_view name, const std::string &string_input,
+             const allocator_type &alloc = {})
+      : InputBlock(alloc) {
+    m_name = name;
     add(string_input);
   }
 
-  //! Construct from plain text file, in Block{option=value;} format
-  InputBlock(std::string_view name, const std::istream &file) : m_name(name) {
-    add(file_to_string(file));
+  //! Construct from plain text file, in Block{option=value;} format.
+  //! File is read (and parsed) in chunks; it is never copied into one string
+  InputBlock(std::string_view name, const std::istream &file,
+             const allocator_type &alloc = {})
+      : InputBlock(alloc) {
+    m_name = name;
+    parse(file);
   }
 
-  //! Add a new InputBlock (merge: will be merged with existing if names match)
-  inline void add(InputBlock block, bool merge = false);
+  allocator_type get_allocator() const { return m_options.get_allocator(); }
+
+  //! Construct from named file, in Block{option=value;} format. File is
+  //! memory-mapped and parsed directly (no copies of the file are made).
+  //! If file cannot be opened, returned InputBlock will be empty
+  //! num_threads: see addParallel (default: serial)
+  static inline InputBlock fromFile(std::string_view name,
+                                    const std::string &filename,
+                                    unsigned num_threads = 1,
+                                    const allocator_type &alloc = {});
+
+  //! As fromFile, but lazy: only the top level is parsed straight away. For
+  //! each block, only its name and location in the text are recorded; its
+  //! contents are parsed (in the same way) on first access, e.g., by get,
+  //! findBlock, options() or blocks(). Safe to access from several threads.
+  //! The file is read into memory (one copy, kept while any of its blocks
+  //! exist), so later changes to the file have no effect on its blocks.
+  static inline InputBlock fromFileLazy(std::string_view name,
+                                        const std::string &filename,
+                                        const allocator_type &alloc = {});
+  //! As fromFileLazy, for a string (kept alive while any of its blocks exist)
+  static inline InputBlock fromStringLazy(std::string_view name,
+                                          std::string string_input,
+                                          const allocator_type &alloc = {});
+
+  //! Add a new InputBlock (merge: will be merged with existing if names match:
+  //! its options are appended, and its sub-blocks are merged in the same way)
+  //! nb: rvalues are moved in (never deep-copied)
+  inline void add(InputBlock &&block, bool merge = false);
+  void add(const InputBlock &block, bool merge = false) {
+    add(InputBlock(block), merge);
+  }
   //! Adds a new option to end of list
-  inline void add(Option option);
+  inline void add(Option &&option);
+  void add(const Option &option) { add(Option(option)); }
+  inline void add(std::vector<Option> &&options);
   inline void add(const std::vector<Option> &options);
   //! Adds options/inputBlocks by parsing a string
   inline void add(const std::string &string, bool merge = false);
+  //! As add(string), but large inputs are split (at top-level ';' and '}')
+  //! into sections that are parsed concurrently (on the shared thread pool,
+  //! using at most num_threads threads; 0: one per core), then joined in
+  //! order. Result, and any errors reported, are identical to add(). If
+  //! parsing a section throws, the exception is rethrown once all finish
+  inline void addParallel(std::string_view string, unsigned num_threads = 0,
+                          bool merge = false);
 
   std::string_view name() const { return m_name; }
   //! Return const reference to list of options
-  const std::vector<Option> &options() const { return m_options; }
+  const std::pmr::vector<Option> &options() const {
+    materialize();
+    return m_options;
+  }
   //! Return const reference to list of blocks
-  const std::vector<InputBlock> &blocks() const { return m_blocks; }
+  const std::pmr::vector<InputBlock> &blocks() const {
+    materialize();
+    return m_blocks;
+  }
 
   //! Comparison of blocks compares the 'name'
-  friend inline bool operator==(InputBlock block, std::string_view name);
-  friend inline bool operator==(std::string_view name, InputBlock block);
-  friend inline bool operator!=(InputBlock block, std::string_view name);
-  friend inline bool operator!=(std::string_view name, InputBlock block);
+  friend inline bool operator==(const InputBlock &block, std::string_view name);
+  friend inline bool operator==(std::string_view name, const InputBlock &block);
+  friend inline bool operator!=(const InputBlock &block, std::string_view name);
+  friend inline bool operator!=(std::string_view name, const InputBlock &block);
+
+  //! Structural hash: of the name, and of each option and sub-block (in
+  //! order). Equal blocks have equal hashes, and it is the same on every run
+  //! and platform, so it can be used as a cache key ("has the input changed").
+  //! O(size) on first call, then O(1): it is kept up to date (in O(1)) as
+  //! options/blocks are added
+  inline std::uint64_t hash() const;
+  //! Same name, options and sub-blocks, in the same order (i.e., same
+  //! print()). Blocks with different hashes are rejected in O(1)
+  friend inline bool operator==(const InputBlock &a, const InputBlock &b);
+  friend inline bool operator!=(const InputBlock &a, const InputBlock &b);
+
+  enum class ChangeType { Added, Removed, Changed };
+  //! One difference between two InputBlocks (see diff)
+  struct Change {
+    ChangeType type;
+    std::vector<std::string> path; // blocks containing option/block
+    std::string name;
+    bool is_block{false};
+    std::string old_value{}, new_value{}; // for options
+  };
+  //! Differences from this block to 'other': options added, removed, or with
+  //! a different value, and blocks added or removed. Options are compared by
+  //! the value get() would return (the last one of that key); blocks are
+  //! matched by name (the n-th of each name with the n-th). Matching blocks
+  //! with equal hashes are skipped without looking inside them
+  inline std::vector<Change> diff(const InputBlock &other) const;
 
   //! If 'key' exists in the options, returns value. Else, returns
   //! default_value. Note: If two keys with same name, will use the later
@@ -135,24 +1023,111 @@ public:
 
   //! Get value from set of nested blocks. .get({block1,block2},option)
   template <typename T>
-  T get(std::initializer_list<std::string> blocks, std::string_view key,
+  T get(std::initializer_list<std::string_view> blocks, std::string_view key,
         T default_value) const;
   //! As above, but without default value
   template <typename T>
-  std::optional<T> get(std::initializer_list<std::string> blocks,
+  std::optional<T> get(std::initializer_list<std::string_view> blocks,
                        std::string_view key) const;
 
   //! Returns optional InputBlock. Contains InputBlock if block of given name
   //! exists; empty otherwise.
   inline std::optional<InputBlock> getBlock(std::string_view name) const;
 
+  //! As get(key), but values that cannot be parsed as a T (e.g., "1.5abc" for
+  //! double) are reported (to cout) and give an empty optional, rather than
+  //! being silently (partially) converted
+  template <typename T = std::string>
+  std::optional<T> getStrict(std::string_view key) const;
+  template <typename T>
+  T getStrict(std::string_view key, T default_value) const {
+    return getStrict<T>(key).value_or(default_value);
+  }
+
+  //! Reads comma-separated list option 'key' into 'list' (re-uses its
+  //! memory). Returns false (and 'list' is untouched) if option doesn't exist
+  //! or is blank. Much faster than get<std::vector<T>> for very long lists
+  template <typename T>
+  bool getList(std::string_view key, std::vector<T> &list) const;
+  //! Writes (at most) first 'size' elements of list option 'key' into 'buffer'.
+  //! Returns total number of elements in list (0 if option doesn't exist)
+  template <typename T>
+  std::size_t getList(std::string_view key, T *buffer, std::size_t size) const;
+
+  //! Pre-resolved handle to an option; see Key
+  template <typename T> class Key;
+  //! Resolves option 'key' (in nested blocks: {block1,block2}) once, giving a
+  //! handle that can be read repeatedly (e.g., in hot loops) with no look-ups
+  //! or allocations: .makeKey<double>({"Dog","Puppy"},"mass").get(0.0)
+  template <typename T = std::string>
+  Key<T> makeKey(std::initializer_list<std::string_view> blocks,
+                 std::string_view key) const {
+    return Key<T>(this, blocks, key);
+  }
+  template <typename T = std::string>
+  Key<T> makeKey(std::string_view key) const {
+    return Key<T>(this, {}, key);
+  }
+
   //! Get an 'Option' (kay, value) - rarely needed
   inline std::optional<Option> getOption(std::string_view key) const;
 
+  //! As getBlock, but returns pointer to the block (no copy); nullptr if block
+  //! does not exist. Valid until this InputBlock is next modified
+  const InputBlock *findBlock(std::string_view name) const {
+    return getBlock_cptr(name);
+  }
+  //! Pointer to nested block: .findBlock({block1,block2}); nullptr if missing
+  inline const InputBlock *
+  findBlock(std::initializer_list<std::string_view> blocks) const;
+
+  //! As getOption, but returns pointer to the option (no copy); nullptr if
+  //! option does not exist. Valid until this InputBlock is next modified
+  const Option *findOption(std::string_view key) const {
+    return getOption_cptr(key);
+  }
+
+#if defined(USERIO_TELEMETRY)
+  //! Access statistics: only with USERIO_TELEMETRY defined. Counts each
+  //! look-up of an option/block by the user (get, getStrict, getList,
+  //! Key::get, getOption, findOption, getBlock, findBlock), and time spent
+  //! parsing each option's value (cached values cost nothing)
+  struct AccessStats {
+    std::string path;     // e.g., "Dog/Puppy/mass"; blocks: "Dog/Puppy{}"
+    bool found;           // false: does not exist (so default value used)
+    std::uint64_t count;  // number of look-ups
+    double parse_seconds; // total time spent parsing value (options only)
+  };
+  //! For every option and block in the tree (accessed or not), and every
+  //! missing option/block that was looked up. Blocks that were never parsed
+  //! (see fromFileLazy) are listed, but not their contents
+  inline std::vector<AccessStats> accessStats() const;
+  //! Paths of options (in this and all sub-blocks) that were never looked up
+  inline std::vector<std::string> unusedOptions() const;
+  //! Prints a summary of accessStats(): most-used first, then missing, then
+  //! unused options
+  inline void printAccessReport(std::ostream &os = std::cout) const;
+#endif
+
   //! Prints options to screen in user-friendly form. Same form as input string.
   //! By default prints to cout, but can be given any ostream
   inline void print(std::ostream &os = std::cout, int indent_depth = 0) const;
 
+  //! Layout for serialize(). Pretty: identical to print(). Minified: no
+  //! optional spaces or new lines (e.g., "a=1;B{x=2;}"). Both parse back to
+  //! the same InputBlock
+  enum class Layout { Pretty, Minified };
+  //! This block's options and sub-blocks, in input format (as print())
+  inline std::string serialize(Layout layout = Layout::Pretty) const;
+  //! As above, appended to 'out' (so that one buffer can be re-used)
+  inline void serialize(std::string &out,
+                        Layout layout = Layout::Pretty) const;
+  //! As above, written in chunks to sink, called as sink(std::string_view),
+  //! e.g., to write straight to a file. Memory use is bounded by chunk size
+  template <typename Sink>
+  void serialize(Sink &&sink, Layout layout = Layout::Pretty,
+                 std::size_t chunk_size = 1 << 16) const;
+
   //! Check all the options and blocks in this; if any of them are not present
   //! in 'list', then there is likely a spelling error in the input => returns
   //! false, warns user, and prints all options to screen. list is a pair:
@@ -164,112 +1139,1082 @@ public:
              bool print = false) const;
 
   inline bool
-  check(std::initializer_list<std::string> blocks,
+  check(std::initializer_list<std::string_view> blocks,
         const std::vector<std::pair<std::string, std::string>> &list,
         bool print = false) const;
 
-private:
-  // Allows returning std::vector: comma-separated list input
-  template <typename T>
-  std::optional<std::vector<T>> get_vector(std::string_view key) const;
+  //! Checks the entire tree against a Schema in one pass: warns (to cout)
+  //! about every unknown option/block and every value that cannot be parsed
+  //! as its expected type, and prints the available options of any block with
+  //! a problem (or with a 'help' option, or all if print=true). Returns false
+  //! if any problems. Cf. checkBlock/check, which check a single block
+  inline bool validate(const Schema &schema, bool print = false) const;
 
+private:
   inline InputBlock *getBlock_ptr(std::string_view name);
+  // Look-ups on behalf of user (counted, with USERIO_TELEMETRY)
   inline const InputBlock *getBlock_cptr(std::string_view name) const;
+  inline const Option *getOption_cptr(std::string_view key) const;
+  // Internal look-ups (never counted)
+  inline const InputBlock *find_block(std::string_view name) const;
+  inline const Option *find_option(std::string_view key) const;
+
+  // All additions to m_options/m_blocks go via these, to keep index (and
+  // value cache) current. reindex() must be called after any other change
+  inline void push_option(Option option);
+  inline InputBlock &push_block(InputBlock block);
+  inline void reindex();
 
-  inline void add_option(std::string_view in_string);
-  inline void add_blocks_from_string(std::string_view string, bool merge);
   inline void consolidate();
+#if defined(USERIO_TELEMETRY)
+  inline void access_stats(const std::string &prefix,
+                           std::vector<AccessStats> &stats) const;
+#endif
+  // Appends other's options, and merges its blocks (recursively)
+  inline void merge_from(InputBlock &&other);
+  static inline std::uint64_t option_hash(const Option &option);
+  // child.merge_from(other), for child in m_blocks (keeps hash current)
+  inline void merge_into(InputBlock &child, InputBlock &&other);
+  inline void diff(const InputBlock &other, std::vector<std::string> &path,
+                   std::vector<Change> &changes) const;
+  // Number of options + blocks, and approx. memory, of the (parsed part of
+  // the) tree; for ParseTracer
+  inline detail::TreeStats tree_stats() const;
+
+  // Parses body of a lazy block (once); no-op otherwise
+  inline void materialize() const;
+  inline void parse_lazy(std::shared_ptr<const void> source,
+                         std::string_view text, std::size_t line = 1,
+                         std::size_t column = 1);
+
+  // Converts option's value to T (using/updating the value cache)
+  template <typename T>
+  std::optional<T> get_value(const Option *option) const;
+  // parse_value (timed, with USERIO_TELEMETRY)
+  template <typename T>
+  std::optional<T> timed_parse(const Option *option) const;
+
+  inline void parse(std::string_view text, bool merge = false);
+  inline void parse(const std::istream &file);
+
+  // Writes tree (iteratively) to out, which provides append(string_view) and
+  // push_back(char). depth != 0: own name is written too (see print)
+  template <typename Out>
+  void write_text(Out &out, Layout layout, int depth) const;
+
+  // Lexer handler: builds the tree of blocks as the input is lexed
+  class Builder;
 };
 
 //******************************************************************************
-//******************************************************************************
-void InputBlock::add(InputBlock block, bool merge) {
-  auto existing_block = getBlock_ptr(block.m_name);
-  if (merge && existing_block) {
-    existing_block->m_options.insert(existing_block->m_options.end(),
-                                     block.m_options.cbegin(),
-                                     block.m_options.cend());
-  } else {
-    m_blocks.push_back(block);
+//! Handle to one option of an InputBlock (possibly in nested blocks), made by
+//! InputBlock::makeKey<T>(). The path is resolved once; get() then reads the
+//! option directly (parsed value is cached, see ValueCache), so costs O(1)
+//! with no allocations. If the InputBlock it was made from is modified (add,
+//! assignment), it is re-resolved on next get(). Must not outlive (or be used
+//! after moving) that InputBlock. Not thread-safe: use one Key per thread.
+template <typename T> class InputBlock::Key {
+public:
+  //! Value of option, or empty optional if it doesn't exist (as for get<T>)
+  std::optional<T> get() const {
+    if (m_version != m_root->m_version.id())
+      resolve();
+#if defined(USERIO_TELEMETRY)
+    if (m_option)
+      m_block->m_telemetry.hit_option(
+          std::size_t(m_option - m_block->m_options.data()));
+    else if (m_block)
+      m_block->m_telemetry.miss_option(m_key);
+#endif
+    return m_block ? m_block->get_value<T>(m_option) : std::nullopt;
   }
-}
+  //! Value of option, or default_value if it doesn't exist
+  T get(T default_value) const { return get().value_or(default_value); }
+
+private:
+  friend class InputBlock;
+  Key(const InputBlock *root, std::initializer_list<std::string_view> blocks,
+      std::string_view key)
+      : m_root(root), m_path(blocks.begin(), blocks.end()), m_key(key) {
+    resolve();
+  }
+
+  void resolve() const {
+    m_version = m_root->m_version.id();
+    m_block = m_root;
+    m_option = nullptr;
+    for (const auto &name : m_path) {
+      m_block = m_block->find_block(name);
+      if (m_block == nullptr)
+        return;
+    }
+    m_option = m_block->find_option(m_key);
+  }
+
+  const InputBlock *m_root;
+  std::vector<std::string> m_path;
+  std::string m_key;
+  mutable std::uint64_t m_version{0};
+  mutable const InputBlock *m_block{nullptr};
+  mutable const Option *m_option{nullptr};
+};
 
 //******************************************************************************
-void InputBlock::add(Option option) { m_options.push_back(option); }
-void InputBlock::add(const std::vector<Option> &options) {
-  for (const auto &option : options)
-    m_options.push_back(option);
-}
-//******************************************************************************
-void InputBlock::add(const std::string &string, bool merge) {
-  add_blocks_from_string(removeSpaces(removeComments(string)), merge);
-}
+//! Description of the options and blocks allowed in an InputBlock (and,
+//! optionally, their expected types and the schemas of sub-blocks). Built
+//! once, then used to validate an entire input (InputBlock::validate), e.g.:
+//!   Schema puppy;
+//!   puppy.option<double>("mass", "Mass, in kg");
+//!   Schema dog;
+//!   dog.option<double>("mass", "Mass, in kg").block("Puppy", puppy, "Child");
+//! Entries are hashed, so each look-up is O(1) regardless of size
+class Schema {
+public:
+  enum class Kind { Option, Block, Either };
+  struct Entry {
+    std::string name{};
+    std::string description{};
+    Kind kind{Kind::Either};
+    // Returns true if value is valid; nullptr: any value allowed
+    bool (*check)(std::string_view value){nullptr};
+    // nullptr: contents of block are not checked
+    std::shared_ptr<const Schema> schema{};
+  };
+
+  enum class IssueType { UnknownOption, UnknownBlock, InvalidValue };
+  struct Issue {
+    IssueType type;
+    std::vector<std::string> path; // blocks containing option/block
+    std::string name;
+    std::string value{}; // for options
+  };
+
+  Schema() = default;
+  //! From a checkBlock-style list of {name, description}: each name may be an
+  //! option (of any value) or a block (contents not checked)
+  inline Schema(const std::vector<std::pair<std::string, std::string>> &list);
+
+  //! Allowed option. Unless T is std::string, value must be a valid T (as for
+  //! getStrict; blank and "default" are always allowed)
+  template <typename T = std::string>
+  Schema &option(std::string_view name, std::string_view description = "");
+  //! Allowed block; its contents are checked against schema
+  inline Schema &block(std::string_view name, Schema schema,
+                       std::string_view description = "");
+  //! Allowed block; its contents are not checked
+  inline Schema &block(std::string_view name,
+                       std::string_view description = "");
+
+  //! Entry for name; nullptr if not in schema
+  inline const Entry *find(std::string_view name) const;
+  const std::vector<Entry> &entries() const { return m_entries; }
+
+  //! Every problem in block (and all its sub-blocks), in input order
+  inline std::vector<Issue> validate(const InputBlock &block) const;
+
+  //! Prints allowed options/blocks, with descriptions (as checkBlock)
+  inline void printHelp(std::string_view block_name,
+                        std::ostream &os = std::cout) const;
+
+  //! Prints the warning for one problem, 'in' the given block (path); used by
+  //! checkBlock, getStrict and InputBlock::validate, so all read the same
+  static inline void printIssue(IssueType type, std::string_view in,
+                                std::string_view name,
+                                std::string_view value = "",
+                                std::ostream &os = std::cout);
+
+private:
+  std::vector<Entry> m_entries{};
+  KeyIndex m_index{};
+
+  inline Schema &add(Entry entry);
+  inline void validate(const InputBlock &block, std::vector<std::string> &path,
+                       std::vector<Issue> &issues) const;
+};
 
 //******************************************************************************
-bool operator==(InputBlock block, std::string_view name) {
-  return block.m_name == name;
-}
-bool operator==(std::string_view name, InputBlock block) {
-  return block == name;
+//! Binds struct S to an InputBlock, so it can be filled in one pass (bind).
+//! Specialise for each struct, listing its fields:
+//!   struct Dog { double mass = 1.0; std::vector<int> list{}; Puppy puppy{}; };
+//!   template <> struct UserIO::Binding<Dog> {
+//!     static constexpr auto fields = std::make_tuple(
+//!         UserIO::field("mass", &Dog::mass, "Mass, in kg"),
+//!         UserIO::field("list", &Dog::list, "Some integers"),
+//!         UserIO::field("Puppy", &Dog::puppy, "Young dog"));
+//!   };
+//! Members that are themselves bound structs are filled from the sub-block of
+//! that name; std::vector's of bound structs from every such sub-block. All
+//! others are filled from the option of that name.
+template <typename S> struct Binding;
+
+namespace detail {
+// FNV-1a hash, usable at compile time
+constexpr std::uint64_t hash_name(std::string_view name) {
+  std::uint64_t hash = 14695981039346656037ull;
+  for (const char c : name)
+    hash = (hash ^ std::uint64_t(static_cast<unsigned char>(c))) *
+           1099511628211ull;
+  return hash;
 }
-bool operator!=(InputBlock block, std::string_view name) {
-  return !(block == name);
+} // namespace detail
+
+//! One field of a Binding
+template <typename S, typename M> struct Field {
+  std::string_view name;
+  M S::*member;
+  std::string_view description;
+  std::uint64_t hash; // of name, so look-ups compare hashes first
+};
+template <typename S, typename M>
+constexpr Field<S, M> field(std::string_view name, M S::*member,
+                            std::string_view description = "") {
+  return {name, member, description, detail::hash_name(name)};
 }
-bool operator!=(std::string_view name, InputBlock block) {
-  return !(block == name);
+
+//! True if Binding<T> has been specialised
+template <typename T, typename = void> struct IsBound {
+  constexpr static bool v = false;
+};
+template <typename T>
+struct IsBound<T, std::void_t<decltype(Binding<T>::fields)>> {
+  constexpr static bool v = true;
+};
+
+//! Fills object from block (and its sub-blocks), in a single pass over its
+//! options/blocks; members with no matching option keep their values (i.e.,
+//! defaults). As for get, later options override earlier ones. Returns false
+//! if any option/block is not in Binding<S>, or any value cannot be parsed
+//! (that member is then left unchanged)
+template <typename S> bool bind(const InputBlock &block, S &object);
+//! As above, but starts from a default-constructed S
+template <typename S> S bind(const InputBlock &block) {
+  S object{};
+  bind(block, object);
+  return object;
+}
+//! Schema (with expected types, and nested schemas) generated from Binding<S>,
+//! e.g., for input.validate(bindingSchema<S>()) or printHelp
+template <typename S> Schema bindingSchema();
+//! List of {name, description} from Binding<S>, for checkBlock
+template <typename S>
+std::vector<std::pair<std::string, std::string>> bindingList();
+
+//******************************************************************************
+//! Compact, read-only alternative to InputBlock, for large inputs. The whole
+//! tree lives in three flat arrays: one text buffer holding every name, key
+//! and value (comments/spaces stripped, so never larger than the input), a
+//! node table for the blocks, and an entry table for the options. Names, keys
+//! and values are string_views into the text buffer, so parse time and memory
+//! scale with the input size, not the number of tokens (a handful of
+//! allocations in total). Same format, and same lookup rules (later options
+//! override earlier ones), as InputBlock. Inputs are limited to 4 GiB of
+//! names/keys/values, and fewer than 2^32 blocks and options: larger inputs
+//! throw std::length_error (rather than silently wrapping 32-bit indices).
+//! The flat arrays can be saved as a binary snapshot (writeSnapshot), which is
+//! later loaded by memory-mapping it, with no parsing (loadSnapshot).
+class InputTree {
+public:
+  class BlockView;
+  //! Non-owning key/value pair (cf. Option)
+  struct OptionView {
+    std::string_view key;
+    std::string_view value_str;
+  };
+
+  InputTree() : InputTree("", "") {}
+  //! Parse string with Block{option=value;} format.
+  //! All memory (including temporary memory used while parsing) is allocated
+  //! from 'resource', e.g., a std::pmr::monotonic_buffer_resource, so that an
+  //! entire tree can be released at once
+  InputTree(std::string_view name, std::string_view text,
+            std::pmr::memory_resource *resource = std::pmr::get_default_resource())
+      : m_text_store(resource),
+        m_node_store(resource),
+        m_entry_store(resource) {
+    parse(name, text);
+  }
+  //! Parse named file (memory-mapped; see MappedFile)
+  static inline InputTree
+  fromFile(std::string_view name, const std::string &filename,
+           std::pmr::memory_resource *resource =
+               std::pmr::get_default_resource());
+
+  //! nb: copies use the default memory resource; moves keep other's
+  InputTree(const InputTree &other) { *this = other; }
+  InputTree(InputTree &&other) noexcept
+      : m_text_store(std::move(other.m_text_store)),
+        m_node_store(std::move(other.m_node_store)),
+        m_entry_store(std::move(other.m_entry_store)),
+        m_snapshot(std::move(other.m_snapshot)) {
+    attach_from(other);
+  }
+  inline InputTree &operator=(const InputTree &other);
+  inline InputTree &operator=(InputTree &&other) noexcept;
+
+  //! Checksum of input (block name + text), used to detect stale snapshots
+  static inline std::uint64_t checksum(std::string_view name,
+                                       std::string_view text);
+  //! Writes binary snapshot of this tree. source_checksum identifies the input
+  //! it was parsed from (see checksum()). Written to a temporary file which
+  //! then replaces filename, so readers never see a partial snapshot. Returns
+  //! false on failure (filename is then left as it was)
+  inline bool writeSnapshot(const std::string &filename,
+                            std::uint64_t source_checksum = 0) const;
+  //! Loads snapshot by memory-mapping it: no parsing, and O(1) set-up.
+  //! Empty if file is missing, not a (compatible) snapshot, or, if
+  //! source_checksum is given, if it was made from a different input (stale)
+  static inline std::optional<InputTree>
+  loadSnapshot(const std::string &filename,
+               std::optional<std::uint64_t> source_checksum = std::nullopt);
+  //! As fromFile, but uses snapshot_filename as a cache: loaded if it is
+  //! up-to-date with the input file, otherwise input is parsed and a new
+  //! snapshot is written
+  static inline InputTree fromFileCached(std::string_view name,
+                                         const std::string &filename,
+                                         const std::string &snapshot_filename);
+
+  //! View of outer-most block
+  inline BlockView root() const;
+  //! Copy into a regular (mutable) InputBlock
+  inline InputBlock toInputBlock() const;
+
+  //! Bytes of memory allocated for the text buffer and tables (0 if loaded
+  //! from a snapshot: data is then read directly from the mapped file)
+  std::size_t memory() const {
+    if (m_snapshot)
+      return 0;
+    return m_text_store.capacity() + m_node_store.capacity() * sizeof(Node) +
+           m_entry_store.capacity() * sizeof(Entry);
+  }
+
+private:
+  // [begin, begin+size) in m_text
+  struct Span {
+    std::uint32_t begin{0}, size{0};
+  };
+  // Children of a node, and its options, are each contiguous
+  struct Node {
+    Span name{};
+    std::uint32_t first_option{0}, num_options{0};
+    std::uint32_t first_child{0}, num_children{0};
+  };
+  struct Entry {
+    Span key{}, value{};
+  };
+
+  // Binary snapshot file layout: Header, then node table, entry table, text
+  struct Header {
+    char magic[8];
+    std::uint32_t format_version;
+    std::uint32_t byte_order; // detects snapshots from other-endian machines
+    std::uint64_t source_checksum;
+    std::uint64_t num_nodes, num_entries, text_size;
+  };
+  static constexpr char snapshot_magic[8] = {'U', 'I', 'O', 'T',
+                                             'R', 'E', 'E', '\0'};
+  static constexpr std::uint32_t snapshot_version = 1;
+  static constexpr std::uint32_t byte_order_mark = 0x01020304;
+
+  // Storage: either owned (parsed), or memory-mapped snapshot file
+  std::pmr::string m_text_store{};
+  std::pmr::vector<Node> m_node_store{};
+  std::pmr::vector<Entry> m_entry_store{};
+  std::shared_ptr<const MappedFile> m_snapshot{};
+  // Views of the storage
+  std::string_view m_text{};
+  const Node *m_nodes{nullptr}; // m_nodes[0] is outer-most block
+  const Entry *m_entries{nullptr};
+  std::size_t m_num_nodes{0}, m_num_entries{0};
+
+  std::string_view text(Span span) const {
+    return m_text.substr(span.begin, span.size);
+  }
+  // Points views at owned storage
+  void attach() {
+    m_text = m_text_store;
+    m_nodes = m_node_store.data();
+    m_num_nodes = m_node_store.size();
+    m_entries = m_entry_store.data();
+    m_num_entries = m_entry_store.size();
+  }
+  // After copy/move of stores from other: point to stores, or to other's
+  // mapped snapshot
+  void attach_from(const InputTree &other) {
+    if (!m_snapshot) {
+      // nb: short text may be stored inside the string object itself
+      attach();
+      return;
+    }
+    m_text = other.m_text;
+    m_nodes = other.m_nodes;
+    m_num_nodes = other.m_num_nodes;
+    m_entries = other.m_entries;
+    m_num_entries = other.m_num_entries;
+  }
+
+  inline void parse(std::string_view name, std::string_view text);
+  inline void to_input_block(std::uint32_t node, InputBlock &block) const;
+  class Builder;
+};
+
+//******************************************************************************
+//! Cheap (pointer + index) handle to one block of an InputTree. Only valid while
+//! the InputTree is alive. Mirrors the read-only part of InputBlock's interface
+class InputTree::BlockView {
+public:
+  std::string_view name() const { return m_tree->text(node().name); }
+
+  //! Options, in order they appear in input
+  std::size_t num_options() const { return node().num_options; }
+  OptionView option(std::size_t i) const {
+    const auto &entry = m_tree->m_entries[node().first_option + i];
+    return {m_tree->text(entry.key), m_tree->text(entry.value)};
+  }
+  //! Nested blocks, in order they appear in input
+  std::size_t num_blocks() const { return node().num_children; }
+  BlockView block(std::size_t i) const {
+    return {m_tree, std::uint32_t(node().first_child + i)};
+  }
+
+  //! Value of (last) option 'key', or empty optional. See InputBlock::get
+  template <typename T = std::string>
+  std::optional<T> get(std::string_view key) const {
+    const auto option = findOption(key);
+    return option ? parse_value<T>(option->value_str) : std::nullopt;
+  }
+  template <typename T> T get(std::string_view key, T default_value) const {
+    static_assert(!std::is_same_v<T, const char *>,
+                  "Cannot use get with const char* - use std::string");
+    return get<T>(key).value_or(default_value);
+  }
+  //! Get value from set of nested blocks. .get({block1,block2},option)
+  template <typename T = std::string>
+  std::optional<T> get(std::initializer_list<std::string_view> blocks,
+                       std::string_view key) const {
+    const auto block = getBlock(blocks);
+    return block ? block->get<T>(key) : std::nullopt;
+  }
+  template <typename T>
+  T get(std::initializer_list<std::string_view> blocks, std::string_view key,
+        T default_value) const {
+    return get<T>(blocks, key).value_or(default_value);
+  }
+
+  //! (Last) nested block with given name, or empty optional
+  inline std::optional<BlockView> getBlock(std::string_view name) const;
+  inline std::optional<BlockView>
+  getBlock(std::initializer_list<std::string_view> blocks) const;
+  //! (Last) option with given key, or empty optional
+  inline std::optional<OptionView> findOption(std::string_view key) const;
+
+  //! Copy this block into a regular InputBlock
+  InputBlock toInputBlock() const {
+    InputBlock block(name());
+    m_tree->to_input_block(m_node, block);
+    return block;
+  }
+
+private:
+  friend class InputTree;
+  BlockView(const InputTree *tree, std::uint32_t node)
+      : m_tree(tree), m_node(node) {}
+  const Node &node() const { return m_tree->m_nodes[m_node]; }
+
+  const InputTree *m_tree;
+  std::uint32_t m_node;
+};
+
+//******************************************************************************
+//! Keeps an InputBlock up to date with its file, for long-running programs:
+//!   InputWatcher input("params", "params.in");
+//!   input.subscribe([](const auto &snapshot, const auto &changes) {...},
+//!                   {"Solver"}); // only told of changes inside Solver{}
+//!   input.watch();
+//!   ... input.snapshot()->get<double>({"Solver"}, "tolerance") ...
+//! The file is re-parsed only when it has changed (modification time, size).
+//! Each version is published as an immutable snapshot: a reload never
+//! modifies a snapshot that is in use, so snapshots may be read from any
+//! thread. If the new version differs (see InputBlock::diff), subscribers are
+//! told what changed. The file is watched with inotify on Linux (checked as
+//! soon as it is written or replaced), otherwise by polling.
+class InputWatcher {
+public:
+  using Changes = std::vector<InputBlock::Change>;
+  //! Called with the new snapshot and the changes (relative to the previous)
+  using Callback = std::function<void(
+      const std::shared_ptr<const InputBlock> &snapshot, const Changes &)>;
+
+  //! Reads the file now (empty if it cannot be read). Nothing is watched
+  //! until watch() is called
+  inline InputWatcher(std::string_view name, std::string filename);
+  ~InputWatcher() { stop(); }
+  InputWatcher(const InputWatcher &) = delete;
+  InputWatcher &operator=(const InputWatcher &) = delete;
+
+  //! Current version of the input (never modified)
+  std::shared_ptr<const InputBlock> snapshot() const {
+    const std::lock_guard<std::mutex> lock(m_snapshot_mutex);
+    return m_snapshot;
+  }
+
+  //! Calls callback (on the thread doing the reload) after each reload that
+  //! changes the input. If block_path is given, only when something inside
+  //! that block changed, and with only those changes. Returns id, for
+  //! unsubscribe. nb: callback must not call reload()
+  inline std::size_t subscribe(Callback callback,
+                               std::vector<std::string> block_path = {});
+  inline void unsubscribe(std::size_t id);
+
+  //! Re-reads the file if it has been modified since last read; if the
+  //! input has changed, publishes a new snapshot and notifies subscribers.
+  //! Returns true if the input changed. If the file cannot be read, the
+  //! current snapshot is kept. Called by the watch() thread; may also be
+  //! called directly (e.g., on a signal)
+  inline bool reload();
+
+  //! Starts a thread that calls reload() whenever the file changes: woken by
+  //! inotify where available, and in any case at least every poll_interval
+  inline void watch(std::chrono::milliseconds poll_interval =
+                        std::chrono::milliseconds(500));
+  //! Stops watching (if watching); the current snapshot is kept
+  inline void stop();
+
+private:
+  // Identifies a version of the file, without reading it
+  struct Stamp {
+    std::filesystem::file_time_type time{};
+    std::uintmax_t size{0};
+    bool exists{false};
+    bool operator==(const Stamp &other) const {
+      return time == other.time && size == other.size &&
+             exists == other.exists;
+    }
+  };
+  struct Subscriber {
+    std::size_t id;
+    std::vector<std::string> block_path;
+    Callback callback;
+  };
+
+  std::string m_name;
+  std::string m_filename;
+  Stamp m_stamp{};
+  std::shared_ptr<const InputBlock> m_snapshot;
+  mutable std::mutex m_snapshot_mutex{};
+  std::mutex m_reload_mutex{}; // one reload at a time
+  std::vector<Subscriber> m_subscribers{};
+  std::size_t m_next_id{0};
+  std::mutex m_subscriber_mutex{};
+
+  std::thread m_thread{};
+  bool m_stopping{false};
+  std::mutex m_stop_mutex{};
+  std::condition_variable m_stop_cv{};
+#if defined(USERIO_HAVE_INOTIFY)
+  int m_wake_pipe[2]{-1, -1}; // written to by stop(), to wake the thread
+#endif
+
+  inline Stamp stamp() const;
+  // Parsed copy of the file (nb: never mapped, since it may be truncated
+  // while being read); nullptr if it cannot be read
+  inline std::shared_ptr<const InputBlock> read() const;
+  inline void run(std::chrono::milliseconds poll_interval);
+};
+
+//******************************************************************************
+//******************************************************************************
+void InputBlock::add(InputBlock &&block, bool merge) {
+  auto existing_block = merge ? getBlock_ptr(block.m_name) : nullptr;
+  if (existing_block) {
+    m_version.bump();
+    merge_into(*existing_block, std::move(block));
+  } else {
+    push_block(std::move(block));
+  }
+}
+
+//******************************************************************************
+void InputBlock::add(Option &&option) { push_option(std::move(option)); }
+void InputBlock::add(std::vector<Option> &&options) {
+  for (auto &option : options)
+    push_option(std::move(option));
+}
+void InputBlock::add(const std::vector<Option> &options) {
+  for (const auto &option : options)
+    push_option(option);
+}
+//******************************************************************************
+class InputBlock::Builder {
+public:
+  explicit Builder(InputBlock *root) : m_stack{root} {}
+  // Lazy mode: lexer skips contents of each block, which are stored unparsed.
+  // text is the input being lexed (by 'lexer'), owned by source
+  Builder(InputBlock *root, std::shared_ptr<const void> source,
+          std::string_view text)
+      : m_stack{root}, m_source(std::move(source)), m_text(text) {}
+  void setLexer(Lexer<Builder> *lexer) { m_lexer = lexer; }
+
+  void on_option(std::string_view key, std::string_view value) {
+    auto &block = *m_stack.back();
+    block.push_option(Option(key, value, block.get_allocator()));
+  }
+  void on_block_begin(std::string_view name) {
+    auto &block = *m_stack.back();
+    m_stack.push_back(
+        &block.push_block(InputBlock(name, {}, block.get_allocator())));
+    if (m_lexer) {
+      m_lexer->skipBlock();
+      m_body = m_lexer->position();
+    }
+  }
+  void on_block_end() {
+    if (m_lexer) {
+      // Body is everything between the braces
+      const auto end = m_lexer->position().offset;
+      m_stack.back()->m_lazy.reset(new LazyBody{
+          m_source, m_text.substr(m_body.offset + 1, end - m_body.offset - 1),
+          m_body.line, m_body.column + 1});
+    }
+    if (m_stack.size() > 1) {
+      // Parent's hash (if computed) included this block when it was empty
+      auto &parent = *m_stack[m_stack.size() - 2];
+      const auto &block = *m_stack.back();
+      if (parent.m_hash.valid()) {
+        const auto i = std::size_t(&block - parent.m_blocks.data());
+        parent.m_hash.replace_block(i, InputBlock(block.m_name).hash(),
+                                    block.hash());
+      }
+    }
+    m_stack.pop_back();
+  }
+
+private:
+  // Blocks currently open. Only the back() block is ever added to, so these
+  // pointers remain valid while the block is open
+  std::vector<InputBlock *> m_stack;
+  Lexer<Builder> *m_lexer{nullptr};
+  std::shared_ptr<const void> m_source{};
+  std::string_view m_text{};
+  Lexer<Builder>::Position m_body{}; // position of '{' of skipped block
+};
+
+//******************************************************************************
+InputBlock &InputBlock::operator=(const InputBlock &other) {
+  if (this == &other)
+    return *this;
+  m_name = other.m_name;
+  if (other.m_lazy && !other.m_lazy->parsed.load(std::memory_order_acquire)) {
+    const auto &lazy = *other.m_lazy;
+    m_lazy.reset(
+        new LazyBody{lazy.source, lazy.text, lazy.line, lazy.column});
+    m_options.clear();
+    m_blocks.clear();
+    m_option_index.clear();
+    m_block_index.clear();
+    m_cache.clear();
+    m_hash = detail::TreeHash{};
+#if defined(USERIO_TELEMETRY)
+    m_telemetry = detail::Telemetry{};
+#endif
+  } else {
+    m_lazy.reset();
+    m_options = other.m_options;
+    m_blocks = other.m_blocks;
+    m_option_index = other.m_option_index;
+    m_block_index = other.m_block_index;
+    m_cache = other.m_cache;
+    m_hash = other.m_hash;
+#if defined(USERIO_TELEMETRY)
+    m_telemetry = other.m_telemetry;
+#endif
+  }
+  m_version = other.m_version;
+  return *this;
+}
+
+//******************************************************************************
+InputBlock InputBlock::fromFileLazy(std::string_view name,
+                                    const std::string &filename,
+                                    const allocator_type &alloc) {
+  // nb: copied, not mapped: deferred blocks would otherwise see (or crash on,
+  // if truncated) any later edits to the file
+  auto text = read_file(filename);
+  return fromStringLazy(name, text ? std::move(*text) : std::string{}, alloc);
+}
+
+InputBlock InputBlock::fromStringLazy(std::string_view name,
+                                      std::string string_input,
+                                      const allocator_type &alloc) {
+  InputBlock block(name, {}, alloc);
+  const auto text = std::make_shared<const std::string>(std::move(string_input));
+  {
+    detail::PhaseTrace trace("parse", text->size(),
+                             [&block] { return block.tree_stats(); });
+    block.parse_lazy(text, *text);
+  }
+  return block;
+}
+
+void InputBlock::parse_lazy(std::shared_ptr<const void> source,
+                            std::string_view text, std::size_t line,
+                            std::size_t column) {
+  Builder builder(this, std::move(source), text);
+  Lexer lexer(builder, line, column);
+  builder.setLexer(&lexer);
+  lexer.feed(text);
+  lexer.finish();
+}
+
+void InputBlock::materialize() const {
+  if (!m_lazy)
+    return;
+  std::call_once(m_lazy->once, [this] {
+    // Parsed into a separate block, then moved in (so that nothing here
+    // re-enters materialize)
+    InputBlock body(get_allocator());
+    {
+      detail::PhaseTrace trace("materialize", m_lazy->text.size(),
+                               [&body] { return body.tree_stats(); });
+      body.parse_lazy(m_lazy->source, m_lazy->text, m_lazy->line,
+                      m_lazy->column);
+    }
+    m_options = std::move(body.m_options);
+    m_blocks = std::move(body.m_blocks);
+    m_option_index = std::move(body.m_option_index);
+    m_block_index = std::move(body.m_block_index);
+    m_cache = std::move(body.m_cache);
+#if defined(USERIO_TELEMETRY)
+    m_telemetry.reset_options(m_options.size());
+#endif
+    m_lazy->parsed.store(true, std::memory_order_release);
+  });
+}
+
+//******************************************************************************
+void InputBlock::add(const std::string &string, bool merge) {
+  parse(string, merge);
+}
+
+void InputBlock::parse(std::string_view text, bool merge) {
+  const auto stats = [this] { return tree_stats(); };
+  {
+    detail::PhaseTrace trace("parse", text.size(), stats);
+    Builder builder(this);
+    Lexer lexer(builder);
+    lexer.feed(text);
+    lexer.finish();
+  }
+  // Merge duplicated blocks.
+  if (merge) {
+    detail::PhaseTrace trace("consolidate", 0, stats);
+    consolidate();
+  }
+  // No - want ability to have multiple blocks of same name
+}
+
+void InputBlock::parse(const std::istream &file) {
+  if (!file)
+    return;
+  detail::PhaseTrace trace("parse", 0, [this] { return tree_stats(); });
+  // Bytes read, if stream is seekable (only needed for tracing)
+  const auto offset = [&file] {
+    return detail::current_tracer()
+               ? file.rdbuf()->pubseekoff(0, std::ios::cur, std::ios::in)
+               : std::streampos(-1);
+  };
+  const auto begin = offset();
+  Builder builder(this);
+  parse_input(file, builder);
+  const auto end = offset();
+  if (begin != std::streampos(-1) && end != std::streampos(-1))
+    trace.setBytesIn(std::size_t(end - begin));
+}
+
+//******************************************************************************
+InputBlock InputBlock::fromFile(std::string_view name,
+                                const std::string &filename,
+                                unsigned num_threads,
+                                const allocator_type &alloc) {
+  InputBlock block(name, {}, alloc);
+  const MappedFile file(filename);
+  if (num_threads == 1)
+    block.parse(file.view());
+  else
+    block.addParallel(file.view(), num_threads);
+  return block;
+}
+
+//******************************************************************************
+void InputBlock::addParallel(std::string_view string, unsigned num_threads,
+                             bool merge) {
+  auto &pool = detail::ThreadPool::shared();
+  if (num_threads == 0)
+    num_threads = pool.size();
+  // Not worth splitting small inputs
+  const auto num_sections =
+      std::min(std::size_t(num_threads) * 8, string.size() / (64 * 1024));
+  if (num_threads == 1 || num_sections <= 1) {
+    parse(string, merge);
+    return;
+  }
+
+  // Sections are handed out one at a time, so threads that finish early
+  // take more work (one very large block does not hold up the rest)
+  const auto stats = [this] { return tree_stats(); };
+  std::optional<detail::PhaseTrace<decltype(stats)>> trace;
+  trace.emplace("parse_sections", string.size(), stats);
+  const auto sections =
+      detail::split_top_level(string, string.size() / num_sections);
+  // nb: default memory resource, since this block's may not be thread-safe
+  // (results are copied into it when joined)
+  std::vector<InputBlock> results(sections.size());
+  // Errors are collected per section and reported in input order once all
+  // are done (as a serial parse would). If a section throws, the first
+  // exception is rethrown after the others finish, and this is unchanged
+  std::vector<std::ostringstream> errors(sections.size());
+  const auto report = [&] {
+    for (const auto &section_errors : errors)
+      std::cerr << section_errors.str();
+  };
+  try {
+    pool.run(sections.size(), num_threads, [&](std::size_t i) {
+      const auto &section = sections[i];
+      Builder builder(&results[i]);
+      Lexer lexer(builder, section.line, section.column);
+      lexer.setErrorStream(errors[i]);
+      lexer.feed(section.text);
+      lexer.finish();
+    });
+  } catch (...) {
+    report();
+    throw;
+  }
+  report();
+  if (detail::current_tracer()) {
+    // Memory held by the (not yet joined) results
+    std::size_t memory = 0;
+    for (const auto &result : results)
+      memory += result.tree_stats().memory;
+    trace->setMemory(memory);
+  }
+
+  // Join the results in order, so later options still override earlier ones
+  trace.emplace("join", 0, stats);
+  for (auto &result : results) {
+    for (auto &option : result.m_options)
+      push_option(std::move(option));
+    for (auto &block : result.m_blocks)
+      push_block(std::move(block));
+  }
+  if (merge) {
+    trace.emplace("consolidate", 0, stats);
+    consolidate();
+  }
+}
+
+//******************************************************************************
+std::uint64_t InputBlock::option_hash(const Option &option) {
+  return detail::mix64(detail::hash_name(option.key) ^
+                       detail::mix64(detail::hash_name(option.value_str) + 1));
+}
+
+std::uint64_t InputBlock::hash() const {
+  materialize();
+  if (!m_hash.valid()) {
+    std::uint64_t options = 0, blocks = 0;
+    for (std::size_t i = 0; i < m_options.size(); ++i)
+      options += detail::hash_at(i, option_hash(m_options[i]));
+    for (std::size_t i = 0; i < m_blocks.size(); ++i)
+      blocks += detail::hash_at(i, m_blocks[i].hash());
+    m_hash.set(options, blocks);
+  }
+  // nb: counts included, so that moving an entry between lists changes it
+  auto hash = detail::mix64(detail::hash_name(m_name) ^ m_hash.options());
+  hash = detail::mix64(hash + m_options.size());
+  hash = detail::mix64(hash ^ m_hash.blocks());
+  return detail::mix64(hash + m_blocks.size());
+}
+
+bool operator==(const InputBlock &a, const InputBlock &b) {
+  if (&a == &b)
+    return true;
+  // nb: hash() also parses lazy blocks
+  if (a.hash() != b.hash())
+    return false;
+  // Equal hashes: almost certainly equal, but must check
+  const auto same_option = [](const Option &x, const Option &y) {
+    return x.key == y.key && x.value_str == y.value_str;
+  };
+  return a.m_name == b.m_name &&
+         std::equal(a.m_options.begin(), a.m_options.end(),
+                    b.m_options.begin(), b.m_options.end(), same_option) &&
+         std::equal(a.m_blocks.begin(), a.m_blocks.end(), b.m_blocks.begin(),
+                    b.m_blocks.end());
+}
+bool operator!=(const InputBlock &a, const InputBlock &b) { return !(a == b); }
+
+//******************************************************************************
+std::vector<InputBlock::Change> InputBlock::diff(const InputBlock &other) const {
+  std::vector<Change> changes;
+  std::vector<std::string> path;
+  diff(other, path, changes);
+  return changes;
+}
+
+void InputBlock::diff(const InputBlock &other, std::vector<std::string> &path,
+                      std::vector<Change> &changes) const {
+  if (hash() == other.hash())
+    return;
+
+  // Options: each key is compared once, at its last (effective) occurrence
+  for (const auto &option : m_options) {
+    if (find_option(option.key) != &option)
+      continue;
+    const auto theirs = other.find_option(option.key);
+    if (theirs == nullptr) {
+      changes.push_back({ChangeType::Removed, path, std::string(option.key),
+                         false, std::string(option.value_str), ""});
+    } else if (theirs->value_str != option.value_str) {
+      changes.push_back({ChangeType::Changed, path, std::string(option.key),
+                         false, std::string(option.value_str),
+                         std::string(theirs->value_str)});
+    }
+  }
+  for (const auto &option : other.m_options) {
+    if (other.find_option(option.key) == &option &&
+        find_option(option.key) == nullptr) {
+      changes.push_back({ChangeType::Added, path, std::string(option.key),
+                         false, "", std::string(option.value_str)});
+    }
+  }
+
+  // Blocks: n-th of each name matched with n-th of that name in other.
+  // Indices of other's blocks, by name (last first, so back() is next match)
+  std::unordered_map<std::string_view, std::vector<std::size_t>> unmatched;
+  for (auto i = other.m_blocks.size(); i-- > 0;)
+    unmatched[other.m_blocks[i].m_name].push_back(i);
+  std::vector<bool> matched(other.m_blocks.size(), false);
+  for (const auto &block : m_blocks) {
+    const auto found = unmatched.find(block.m_name);
+    if (found == unmatched.end() || found->second.empty()) {
+      changes.push_back(
+          {ChangeType::Removed, path, std::string(block.m_name), true});
+      continue;
+    }
+    const auto i = found->second.back();
+    found->second.pop_back();
+    matched[i] = true;
+    path.emplace_back(block.m_name);
+    block.diff(other.m_blocks[i], path, changes);
+    path.pop_back();
+  }
+  for (std::size_t i = 0; i < other.m_blocks.size(); ++i) {
+    if (!matched[i]) {
+      changes.push_back({ChangeType::Added, path,
+                         std::string(other.m_blocks[i].m_name), true});
+    }
+  }
+}
+
+//******************************************************************************
+bool operator==(const InputBlock &block, std::string_view name) {
+  return block.m_name == name;
+}
+bool operator==(std::string_view name, const InputBlock &block) {
+  return block == name;
+}
+bool operator!=(const InputBlock &block, std::string_view name) {
+  return !(block == name);
+}
+bool operator!=(std::string_view name, const InputBlock &block) {
+  return !(block == name);
 }
 
 //******************************************************************************
 template <typename T>
 std::optional<T> InputBlock::get(std::string_view key) const {
-  if constexpr (IsVector<T>::v) {
-    return get_vector<typename IsVector<T>::t>(key);
-  } else if constexpr (std::is_same_v<T, bool>) {
-    const auto option = std::find(m_options.crbegin(), m_options.crend(), key);
-    if (option == m_options.crend())
-      return std::nullopt;
-    if (option->value_str == "default" || option->value_str == "")
-      return std::nullopt;
-    const auto &str = option->value_str;
-    if (str == "True" || str == "true" || str == "Yes" || str == "yes" ||
-        str == "1" || str == "Y" || str == "y")
-      return true;
-    return false;
+  // Finds _last_ option that matches key
+  // i.e., assume later options override earlier ones.
+  return get_value<T>(getOption_cptr(key));
+}
+
+template <typename T>
+std::optional<T> InputBlock::get_value(const Option *option) const {
+  if (option == nullptr)
+    return std::nullopt;
+  if constexpr (ValueCache::cacheable<T>) {
+    // Options are never modified once added, so cached value is always current
+    const auto &cache = m_cache[std::size_t(option - m_options.data())];
+    if (const auto cached = cache.load<T>())
+      return cached;
+    const auto value = timed_parse<T>(option);
+    if (value)
+      cache.store(*value);
+    return value;
   } else {
-    // Use reverse iterators so that we find _last_ option that matches key
-    // i.e., assume later options override earlier ones.
-    const auto option = std::find(m_options.crbegin(), m_options.crend(), key);
-    if (option == m_options.crend())
-      return std::nullopt;
-    if (option->value_str == "default" || option->value_str == "")
-      return std::nullopt;
-    return parse_str_to_T<T>(option->value_str);
+    return timed_parse<T>(option);
   }
 }
 
-// special function; allows return of std::vector (for comma-separated list
-// input). Optional of vector is kind of redundant, but is this way so it aligns
-// with the other functions (checks if optional is empty when deciding if should
-// return the default value)
 template <typename T>
-std::optional<std::vector<T>>
-InputBlock::get_vector(std::string_view key) const {
-  // Use reverse iterators so that we find _last_ option that matches key
-  // i.e., assume later options override earlier ones.
-  std::vector<T> out;
-  const auto option = std::find(m_options.crbegin(), m_options.crend(), key);
-  if (option == m_options.crend())
+std::optional<T> InputBlock::timed_parse(const Option *option) const {
+#if defined(USERIO_TELEMETRY)
+  const auto t0 = std::chrono::steady_clock::now();
+  auto value = parse_value<T>(option->value_str);
+  const auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                      std::chrono::steady_clock::now() - t0)
+                      .count();
+  m_telemetry.add_parse_time(std::size_t(option - m_options.data()),
+                             std::uint64_t(ns));
+  return value;
+#else
+  return parse_value<T>(option->value_str);
+#endif
+}
+
+template <typename T>
+std::optional<T> InputBlock::getStrict(std::string_view key) const {
+  const auto option = getOption_cptr(key);
+  if (option == nullptr)
     return std::nullopt;
-  if (option->value_str == "")
+  // blank/"default" value is not an error
+  if (option->value_str == "" || option->value_str == "default")
     return std::nullopt;
-  std::stringstream ss(option->value_str);
-  while (ss.good()) {
-    // note: *very* innefficient
-    std::string substr;
-    std::getline(ss, substr, ',');
-    out.push_back(parse_str_to_T<T>(substr));
+  auto value = parse_value<T>(option->value_str, true);
+  if (!value) {
+    Schema::printIssue(Schema::IssueType::InvalidValue, m_name, option->key,
+                       option->value_str);
   }
-  return out;
+  return value;
+}
+
+template <typename T>
+bool InputBlock::getList(std::string_view key, std::vector<T> &list) const {
+  const auto option = getOption_cptr(key);
+  if (option == nullptr || option->value_str == "")
+    return false;
+  parse_list(option->value_str, list);
+  return true;
+}
+
+template <typename T>
+std::size_t InputBlock::getList(std::string_view key, T *buffer,
+                                std::size_t size) const {
+  const auto option = getOption_cptr(key);
+  if (option == nullptr)
+    return 0;
+  const std::string_view list = option->value_str;
+  const auto total = list_size(list);
+  if (total > size) {
+    // Only parse first 'size' elements
+    std::size_t end = 0;
+    for (std::size_t i = 0; i < size; ++i)
+      end = list.find(',', end) + 1;
+    parse_list(list.substr(0, size == 0 ? 0 : end - 1), buffer);
+  } else {
+    parse_list(list, buffer);
+  }
+  return total;
 }
 
 template <typename T>
@@ -280,13 +2225,13 @@ T InputBlock::get(std::string_view key, T default_value) const {
 }
 
 template <typename T>
-T InputBlock::get(std::initializer_list<std::string> blocks,
+T InputBlock::get(std::initializer_list<std::string_view> blocks,
                   std::string_view key, T default_value) const {
   return get<T>(blocks, key).value_or(default_value);
 }
 
 template <typename T = std::string>
-std::optional<T> InputBlock::get(std::initializer_list<std::string> blocks,
+std::optional<T> InputBlock::get(std::initializer_list<std::string_view> blocks,
                                  std::string_view key) const {
   // Find key in nested blocks
   const InputBlock *pB = this;
@@ -301,92 +2246,242 @@ std::optional<T> InputBlock::get(std::initializer_list<std::string> blocks,
 //******************************************************************************
 std::optional<InputBlock> InputBlock::getBlock(std::string_view name) const {
   // note: by copy!
-  const auto block = std::find(m_blocks.crbegin(), m_blocks.crend(), name);
-  if (block == m_blocks.crend())
+  const auto block = getBlock_cptr(name);
+  if (block == nullptr)
     return {};
   return *block;
 }
 
+const InputBlock *
+InputBlock::findBlock(std::initializer_list<std::string_view> blocks) const {
+  const InputBlock *pB = this;
+  for (const auto &block : blocks) {
+    pB = pB->getBlock_cptr(block);
+    if (pB == nullptr)
+      return nullptr;
+  }
+  return pB;
+}
+
 //******************************************************************************
 std::optional<Option> InputBlock::getOption(std::string_view key) const {
-  // Use reverse iterators so that we find _last_ option that matches key
-  // i.e., assume later options override earlier ones.
-  const auto option = std::find(m_options.crbegin(), m_options.crend(), key);
-  if (option != m_options.crend())
+  const auto option = getOption_cptr(key);
+  if (option != nullptr)
     return *option;
   return {};
 }
 
 //******************************************************************************
 void InputBlock::print(std::ostream &os, int depth) const {
+  const auto sink = [&os](std::string_view text) {
+    os.write(text.data(), std::streamsize(text.size()));
+  };
+  detail::ChunkedOutput out(sink, 1 << 16);
+  write_text(out, Layout::Pretty, depth);
+  out.flush();
+}
+
+//******************************************************************************
+std::string InputBlock::serialize(Layout layout) const {
+  std::string out;
+  serialize(out, layout);
+  return out;
+}
 
-  std::string indent = "";
-  for (int i = 1; i < depth; ++i)
-    indent += "  ";
+void InputBlock::serialize(std::string &out, Layout layout) const {
+  write_text(out, layout, 0);
+}
 
-  // Don't print outer-most name
-  if (depth != 0)
-    os << indent << m_name << " { ";
+template <typename Sink>
+void InputBlock::serialize(Sink &&sink, Layout layout,
+                           std::size_t chunk_size) const {
+  detail::ChunkedOutput out(sink, chunk_size);
+  write_text(out, layout, 0);
+  out.flush();
+}
 
-  const auto multi_entry = (!m_blocks.empty() || (m_options.size() > 1));
+template <typename Out>
+void InputBlock::write_text(Out &out, Layout layout, int depth) const {
+  const auto pretty = layout == Layout::Pretty;
+  std::string spaces;
+  const auto indent = [&](int level) {
+    if (level <= 0)
+      return;
+    if (spaces.size() < std::size_t(2 * level))
+      spaces.resize(std::size_t(4 * level), ' ');
+    out.append(std::string_view(spaces).substr(0, std::size_t(2 * level)));
+  };
 
-  if (depth != 0 && multi_entry)
-    os << "\n";
+  // Blocks being written: each frame's options are written when it is
+  // pushed, its sub-blocks one at a time, and its closing brace when popped.
+  // Names are not written at depth 0 (outer-most block)
+  struct Frame {
+    const InputBlock *block;
+    int depth;
+    bool multi_entry;
+    std::size_t next_block;
+  };
+  std::vector<Frame> stack;
+  const auto open = [&](const InputBlock &block, int block_depth) {
+    block.materialize();
+    const auto multi_entry =
+        !block.m_blocks.empty() || block.m_options.size() > 1;
+    const auto nested = block_depth != 0;
+    if (nested) {
+      if (pretty) {
+        indent(block_depth - 1);
+        out.append(block.m_name);
+        out.append(multi_entry ? " { \n" : " { ");
+      } else {
+        out.append(block.m_name);
+        out.push_back('{');
+      }
+    }
+    for (const auto &[key, value] : block.m_options) {
+      if (pretty && nested && multi_entry)
+        indent(block_depth);
+      out.append(key);
+      if (!value.empty()) {
+        out.append(pretty ? " = " : "=");
+        out.append(value);
+      }
+      out.push_back(';');
+      if (pretty)
+        out.push_back(multi_entry ? '\n' : ' ');
+    }
+    stack.push_back({&block, block_depth, multi_entry, 0});
+  };
 
-  for (const auto &[key, value] : m_options) {
-    os << (depth != 0 && multi_entry ? indent + "  " : "");
-    if (value == "")
-      os << key << ';';
-    else
-      os << key << " = " << value << ';';
-    os << (multi_entry ? '\n' : ' ');
+  open(*this, depth);
+  while (!stack.empty()) {
+    auto &frame = stack.back();
+    if (frame.next_block < frame.block->m_blocks.size()) {
+      // nb: frame reference is invalidated by open()
+      open(frame.block->m_blocks[frame.next_block++], frame.depth + 1);
+      continue;
+    }
+    if (frame.depth != 0) {
+      if (pretty && frame.multi_entry)
+        indent(frame.depth - 1);
+      out.append(pretty ? "}\n" : "}");
+    }
+    stack.pop_back();
   }
+}
+
+#if defined(USERIO_TELEMETRY)
+//******************************************************************************
+std::vector<InputBlock::AccessStats> InputBlock::accessStats() const {
+  std::vector<AccessStats> stats;
+  access_stats("", stats);
+  return stats;
+}
 
-  for (const auto &block : m_blocks)
-    block.print(os, depth + 1);
+void InputBlock::access_stats(const std::string &prefix,
+                              std::vector<AccessStats> &stats) const {
+  // nb: contents of unparsed lazy blocks are not parsed just to report them
+  if (m_lazy && !m_lazy->parsed.load(std::memory_order_acquire))
+    return;
+  for (std::size_t i = 0; i < m_options.size(); ++i) {
+    const auto &counter = m_telemetry.option(i);
+    stats.push_back({std::string(prefix).append(m_options[i].key), true,
+                     counter.hits.load(std::memory_order_relaxed),
+                     double(counter.parse_ns.load(std::memory_order_relaxed)) *
+                         1.0e-9});
+  }
+  for (const auto &[key, count] : m_telemetry.missed_options())
+    stats.push_back({prefix + key, false, count, 0.0});
+  for (const auto &[name, count] : m_telemetry.missed_blocks())
+    stats.push_back({prefix + name + "{}", false, count, 0.0});
+  for (const auto &block : m_blocks) {
+    const auto path = std::string(prefix).append(block.m_name);
+    stats.push_back(
+        {path + "{}", true, block.m_telemetry.block_hits(), 0.0});
+    block.access_stats(path + "/", stats);
+  }
+}
 
-  if (depth != 0 && multi_entry)
-    os << indent;
+std::vector<std::string> InputBlock::unusedOptions() const {
+  std::vector<std::string> unused;
+  for (const auto &stat : accessStats()) {
+    if (stat.found && stat.count == 0 && stat.path.back() != '}')
+      unused.push_back(stat.path);
+  }
+  return unused;
+}
 
-  if (depth != 0)
-    os << "}\n";
+void InputBlock::printAccessReport(std::ostream &os) const {
+  auto stats = accessStats();
+  std::stable_sort(stats.begin(), stats.end(),
+                   [](const auto &a, const auto &b) { return a.count > b.count; });
+  // nb: caller's formatting is restored afterwards
+  const auto flags = os.flags();
+  const auto precision = os.precision();
+  os << "Input access report for " << m_name << ":\n"
+     << "  look-ups  parse time (us)  option/block\n";
+  for (const auto &stat : stats) {
+    if (stat.found && stat.count > 0) {
+      os << "  " << std::setw(8) << stat.count << "  " << std::setw(15)
+         << std::fixed << std::setprecision(1) << stat.parse_seconds * 1.0e6
+         << "  " << stat.path << '\n';
+    }
+  }
+  os << "Missing (default value used):\n";
+  for (const auto &stat : stats) {
+    if (!stat.found)
+      os << "  " << std::setw(8) << stat.count << "  " << stat.path << '\n';
+  }
+  os << "Never used:\n";
+  for (const auto &stat : stats) {
+    if (stat.found && stat.count == 0)
+      os << "  " << stat.path << '\n';
+  }
+  os.flags(flags);
+  os.precision(precision);
 }
+#endif
 
 //******************************************************************************
 bool InputBlock::checkBlock(
     const std::vector<std::pair<std::string, std::string>> &list,
     bool print) const {
+  materialize();
   // Check each option NOT each sub block!
   // For each input option stored, see if it is allowed
   // "allowed" means appears in list
   bool all_ok = true;
+  // Long lists are hashed in place (positions only, names not copied); short
+  // ones are searched linearly, as for options/blocks (see index_threshold)
+  const auto key_of = [&list](std::size_t i) {
+    return std::string_view(list[i].first);
+  };
+  KeyIndex index;
+  if (list.size() > index_threshold)
+    index.build(list.size(), key_of);
+  const auto allowed = [&](std::string_view name) {
+    if (!index.empty())
+      return index.find(name, key_of).has_value();
+    return std::any_of(list.cbegin(), list.cend(),
+                       [name](const auto &s) { return s.first == name; });
+  };
   for (const auto &option : m_options) {
-    const auto is_optionQ = [&](const auto &l) {
-      return option.key == l.first;
-    };
-    const auto bad_option =
-        !std::any_of(list.cbegin(), list.cend(), is_optionQ);
+    const auto bad_option = !allowed(option.key);
     auto help = (option.key == "Help" || option.key == "help") ? true : false;
     if (help)
       print = true;
     if (bad_option && !help) {
       all_ok = false;
-      std::cout << "\n⚠️  WARNING: Unclear input option in " << m_name
-                << ": " << option.key << " = " << option.value_str << ";\n"
-                << "Option may be ignored!\n"
-                << "Check spelling (or update list of options)\n";
+      Schema::printIssue(Schema::IssueType::UnknownOption, m_name, option.key,
+                         option.value_str);
     }
   }
 
   for (const auto &block : m_blocks) {
-    const auto is_blockQ = [&](const auto &b) { return block == b.first; };
-    const auto bad_block = !std::any_of(list.cbegin(), list.cend(), is_blockQ);
+    const auto bad_block = !allowed(block.name());
     if (bad_block) {
       all_ok = false;
-      std::cout << "\n⚠️  WARNING: Unclear input block within " << m_name
-                << ": " << block.name() << "{}\n"
-                << "Block and containing options may be ignored!\n"
-                << "Check spelling (or update list of options)\n";
+      Schema::printIssue(Schema::IssueType::UnknownBlock, m_name,
+                         block.name());
     }
   }
 
@@ -403,7 +2498,7 @@ bool InputBlock::checkBlock(
 
 //! Check one of the sub-blocks
 bool InputBlock::check(
-    std::initializer_list<std::string> blocks,
+    std::initializer_list<std::string_view> blocks,
     const std::vector<std::pair<std::string, std::string>> &list,
     bool print) const {
   // Find key in nested blocks
@@ -421,201 +2516,1935 @@ bool InputBlock::check(
 }
 
 //******************************************************************************
-void InputBlock::add_blocks_from_string(std::string_view string, bool merge) {
+bool InputBlock::validate(const Schema &schema, bool print) const {
+  const auto issues = schema.validate(*this);
+  const auto path_str = [this](const std::vector<std::string> &path) {
+    std::string str(m_name);
+    for (const auto &block : path)
+      str += (str.empty() ? "" : "/") + block;
+    return str;
+  };
+  for (const auto &issue : issues)
+    Schema::printIssue(issue.type, path_str(issue.path), issue.name,
+                       issue.value);
 
-  // Expects that string has comments and spaces removed already
+  // Print available options of each block with a problem, or asking for help
+  // (or all blocks, if print)
+  std::unordered_set<std::string> has_issue;
+  for (const auto &issue : issues)
+    has_issue.insert(path_str(issue.path));
+  const auto print_help = [&](const auto &self, const InputBlock &block,
+                              const Schema &block_schema,
+                              std::vector<std::string> &path) -> void {
+    if (print || has_issue.count(path_str(path)) ||
+        block.find_option("help") || block.find_option("Help")) {
+      std::cout << "\nAvailable " << path_str(path) << " options/blocks are:\n";
+      block_schema.printHelp(block.name());
+    }
+    for (const auto &sub_block : block.m_blocks) {
+      const auto entry = block_schema.find(sub_block.name());
+      if (entry == nullptr || entry->schema == nullptr)
+        continue;
+      path.emplace_back(sub_block.name());
+      self(self, sub_block, *entry->schema, path);
+      path.pop_back();
+    }
+  };
+  std::vector<std::string> path;
+  print_help(print_help, *this, schema, path);
+  return issues.empty();
+}
 
-  auto start = 0ul;
-  while (start < string.length()) {
+//******************************************************************************
+Schema::Schema(const std::vector<std::pair<std::string, std::string>> &list) {
+  for (const auto &[name, description] : list)
+    add({name, description, Kind::Either, nullptr, nullptr});
+}
 
-    // Find the first of either next ';' or open '{'
-    // This is the end of the next input option, or start of block
-    auto end = std::min(string.find(';', start), string.find('{', start));
-    if (end > string.length() || start >= end)
-      break;
+template <typename T>
+Schema &Schema::option(std::string_view name, std::string_view description) {
+  Entry entry{std::string(name), std::string(description), Kind::Option,
+              nullptr, nullptr};
+  if constexpr (!std::is_same_v<T, std::string>) {
+    entry.check = [](std::string_view value) {
+      return value == "" || value == "default" ||
+             parse_value<T>(value, true).has_value();
+    };
+  }
+  return add(std::move(entry));
+}
 
-    if (string.at(end) == ';') {
-      // end of option:
+Schema &Schema::block(std::string_view name, Schema schema,
+                      std::string_view description) {
+  return add({std::string(name), std::string(description), Kind::Block,
+              nullptr, std::make_shared<const Schema>(std::move(schema))});
+}
 
-      this->add_option(string.substr(start, end - start));
+Schema &Schema::block(std::string_view name, std::string_view description) {
+  return add({std::string(name), std::string(description), Kind::Block,
+              nullptr, nullptr});
+}
 
-    } else {
-      // start of block
+Schema &Schema::add(Entry entry) {
+  // An option and a block may share a name
+  if (const auto pos = m_index.find(entry.name, [this](std::size_t i) {
+        return std::string_view(m_entries[i].name);
+      })) {
+    auto &existing = m_entries[*pos];
+    if (existing.kind != entry.kind)
+      entry.kind = Kind::Either;
+    if (entry.check == nullptr && entry.schema == nullptr) {
+      entry.check = existing.check;
+      entry.schema = existing.schema;
+    } else if (entry.schema == nullptr) {
+      entry.schema = existing.schema;
+    } else if (entry.check == nullptr) {
+      entry.check = existing.check;
+    }
+    if (entry.description.empty())
+      entry.description = existing.description;
+    existing = std::move(entry);
+    return *this;
+  }
+  m_entries.push_back(std::move(entry));
+  m_index.insert(m_entries.size() - 1, [this](std::size_t i) {
+    return std::string_view(m_entries[i].name);
+  });
+  return *this;
+}
 
-      // 'name' directly preceeds "{"
-      const auto block_name = string.substr(start, end - start);
-      start = end + 1;
+const Schema::Entry *Schema::find(std::string_view name) const {
+  const auto pos = m_index.find(name, [this](std::size_t i) {
+    return std::string_view(m_entries[i].name);
+  });
+  return pos ? &m_entries[*pos] : nullptr;
+}
 
-      // Now, find *matching* close '}' - ensure balanced
-      int depth_count = 1;
-      auto next_start = start; // + 1;
-      while (depth_count != 0) {
-        if (next_start > string.length())
-          break;
-        const auto next_end = std::min(string.find('{', next_start),
-                                       string.find('}', next_start));
-        if (next_end > string.length())
-          break;
-
-        // count depth of bracket nesting:
-        if (string.at(next_end) == '{')
-          ++depth_count;
-        else
-          --depth_count;
-
-        if (depth_count == 0) {
-          end = next_end;
-          break;
-        }
-        if (depth_count > 100) {
-          std::cerr << "FAIL 271 in InputBlock::add_blocks_from_string: Depth "
-                       "error. Check balanced {} in input\n";
-          end = next_end;
-          break;
-        }
-        next_start = next_end + 1;
-      }
-
-      // Add a new block, populate it with string. Recursive, since blocks may
-      // contain blocks
-      auto &block = m_blocks.emplace_back(block_name);
+std::vector<Schema::Issue> Schema::validate(const InputBlock &block) const {
+  std::vector<Issue> issues;
+  std::vector<std::string> path;
+  validate(block, path, issues);
+  return issues;
+}
 
-      if (end > start)
-        block.add_blocks_from_string(string.substr(start, end - start), merge);
+void Schema::validate(const InputBlock &block, std::vector<std::string> &path,
+                      std::vector<Issue> &issues) const {
+  for (const auto &[key, value] : block.options()) {
+    if (key == "help" || key == "Help")
+      continue;
+    const auto entry = find(key);
+    if (entry == nullptr || entry->kind == Kind::Block)
+      issues.push_back({IssueType::UnknownOption, path, std::string(key),
+                        std::string(value)});
+    else if (entry->check && !entry->check(value))
+      issues.push_back({IssueType::InvalidValue, path, std::string(key),
+                        std::string(value)});
+  }
+  for (const auto &sub_block : block.blocks()) {
+    const auto entry = find(sub_block.name());
+    if (entry == nullptr || entry->kind == Kind::Option) {
+      issues.push_back(
+          {IssueType::UnknownBlock, path, std::string(sub_block.name())});
+    } else if (entry->schema) {
+      path.emplace_back(sub_block.name());
+      entry->schema->validate(sub_block, path, issues);
+      path.pop_back();
     }
+  }
+}
 
-    start = end + 1;
+void Schema::printIssue(IssueType type, std::string_view in,
+                        std::string_view name, std::string_view value,
+                        std::ostream &os) {
+  switch (type) {
+  case IssueType::UnknownOption:
+    os << "\n⚠️  WARNING: Unclear input option in " << in << ": " << name
+       << " = " << value << ";\n"
+       << "Option may be ignored!\n"
+       << "Check spelling (or update list of options)\n";
+    break;
+  case IssueType::UnknownBlock:
+    os << "\n⚠️  WARNING: Unclear input block within " << in << ": " << name
+       << "{}\n"
+       << "Block and containing options may be ignored!\n"
+       << "Check spelling (or update list of options)\n";
+    break;
+  case IssueType::InvalidValue:
+    os << "\n⚠️  WARNING: Could not parse input option in " << in << ": "
+       << name << " = " << value << ";\n"
+       << "Option will be ignored!\n";
+    break;
   }
+}
 
-  // Merge duplicated blocks.
-  if (merge)
-    consolidate();
-  // No - want ability to have multiple blocks of same name
+void Schema::printHelp(std::string_view block_name, std::ostream &os) const {
+  os << block_name << "{\n";
+  for (const auto &entry : m_entries) {
+    os << "  " << entry.name << (entry.kind == Kind::Block ? "{}" : ";")
+       << "  // " << entry.description << "\n";
+  }
+  os << "}\n\n";
 }
 
 //******************************************************************************
-void InputBlock::add_option(std::string_view in_string) {
-  const auto pos = in_string.find('=');
-  const auto option = in_string.substr(0, pos);
-  const auto value = pos < in_string.length() ? in_string.substr(pos + 1) : "";
-  m_options.push_back({std::string(option), std::string(value)});
+namespace detail {
+// Kind of member M of a bound struct
+template <typename M> constexpr bool is_block_field() {
+  if constexpr (IsVector<M>::v)
+    return IsBound<typename IsVector<M>::t>::v;
+  else
+    return IsBound<M>::v;
+}
+// Visits each field of Binding<S>
+template <typename S, typename F> constexpr void for_each_field(F &&f) {
+  std::apply([&](const auto &...fields) { (f(fields), ...); },
+             Binding<S>::fields);
+}
+} // namespace detail
+
+template <typename S> bool bind(const InputBlock &block, S &object) {
+  static_assert(IsBound<S>::v, "bind<S> requires a Binding<S> specialisation");
+  bool all_ok = true;
+  // For each option (in order): unrolled comparison against each field,
+  // comparing pre-computed hashes first
+  for (const auto &[key, value] : block.options()) {
+    const auto hash = detail::hash_name(key);
+    bool found = false;
+    std::apply(
+        [&](const auto &...fields) {
+          const auto try_field = [&](const auto &f) {
+            using M = std::remove_reference_t<decltype(object.*f.member)>;
+            if constexpr (detail::is_block_field<M>()) {
+              return false;
+            } else {
+              if (f.hash != hash || f.name != key)
+                return false;
+              if (value == "" || value == "default")
+                return true;
+              if (auto parsed = parse_value<M>(value, true))
+                object.*f.member = std::move(*parsed);
+              else
+                all_ok = false;
+              return true;
+            }
+          };
+          found = (try_field(fields) || ...);
+        },
+        Binding<S>::fields);
+    all_ok = all_ok && (found || key == "help" || key == "Help");
+  }
+
+  // Sub-blocks: bound structs (or vectors of them) are filled recursively.
+  // Vectors are cleared first, so they hold only the blocks in the input
+  detail::for_each_field<S>([&](const auto &f) {
+    using M = std::remove_reference_t<decltype(object.*f.member)>;
+    if constexpr (detail::is_block_field<M>() && IsVector<M>::v) {
+      if (block.findBlock(f.name))
+        (object.*f.member).clear();
+    }
+  });
+  for (const auto &sub_block : block.blocks()) {
+    const auto hash = detail::hash_name(sub_block.name());
+    bool found = false;
+    std::apply(
+        [&](const auto &...fields) {
+          const auto try_field = [&](const auto &f) {
+            using M = std::remove_reference_t<decltype(object.*f.member)>;
+            if constexpr (!detail::is_block_field<M>()) {
+              return false;
+            } else {
+              if (f.hash != hash || f.name != sub_block.name())
+                return false;
+              if constexpr (IsVector<M>::v)
+                all_ok = bind(sub_block, (object.*f.member).emplace_back()) &&
+                         all_ok;
+              else
+                all_ok = bind(sub_block, object.*f.member) && all_ok;
+              return true;
+            }
+          };
+          found = (try_field(fields) || ...);
+        },
+        Binding<S>::fields);
+    all_ok = all_ok && found;
+  }
+  return all_ok;
+}
+
+template <typename S> Schema bindingSchema() {
+  Schema schema;
+  detail::for_each_field<S>([&](const auto &f) {
+    using M = std::remove_reference_t<decltype(std::declval<S &>().*f.member)>;
+    if constexpr (!detail::is_block_field<M>())
+      schema.option<M>(f.name, f.description);
+    else if constexpr (IsVector<M>::v)
+      schema.block(f.name, bindingSchema<typename IsVector<M>::t>(),
+                   f.description);
+    else
+      schema.block(f.name, bindingSchema<M>(), f.description);
+  });
+  return schema;
+}
+
+template <typename S>
+std::vector<std::pair<std::string, std::string>> bindingList() {
+  std::vector<std::pair<std::string, std::string>> list;
+  detail::for_each_field<S>([&](const auto &f) {
+    list.emplace_back(std::string(f.name), std::string(f.description));
+  });
+  return list;
 }
 
 //******************************************************************************
 InputBlock *InputBlock::getBlock_ptr(std::string_view name) {
-  auto block = std::find(m_blocks.rbegin(), m_blocks.rend(), name);
-  if (block == m_blocks.rend())
-    return nullptr;
-  return &(*block);
+  return const_cast<InputBlock *>(std::as_const(*this).find_block(name));
 }
 
 const InputBlock *InputBlock::getBlock_cptr(std::string_view name) const {
+  const auto block = find_block(name);
+#if defined(USERIO_TELEMETRY)
+  if (block)
+    block->m_telemetry.hit_block();
+  else
+    m_telemetry.miss_block(name);
+#endif
+  return block;
+}
+
+const Option *InputBlock::getOption_cptr(std::string_view key) const {
+  const auto option = find_option(key);
+#if defined(USERIO_TELEMETRY)
+  if (option)
+    m_telemetry.hit_option(std::size_t(option - m_options.data()));
+  else
+    m_telemetry.miss_option(key);
+#endif
+  return option;
+}
+
+const InputBlock *InputBlock::find_block(std::string_view name) const {
+  materialize();
+  // Finds _last_ block that matches name
+  if (!m_block_index.empty()) {
+    const auto pos = m_block_index.find(
+        name, [this](std::size_t i) -> std::string_view {
+          return m_blocks[i].m_name;
+        });
+    return pos ? &m_blocks[*pos] : nullptr;
+  }
   auto block = std::find(m_blocks.crbegin(), m_blocks.crend(), name);
-  if (block == m_blocks.rend())
+  if (block == m_blocks.crend())
     return nullptr;
   return &(*block);
 }
 
+const Option *InputBlock::find_option(std::string_view key) const {
+  materialize();
+  // Finds _last_ option that matches key
+  if (!m_option_index.empty()) {
+    const auto pos = m_option_index.find(
+        key, [this](std::size_t i) -> std::string_view {
+          return m_options[i].key;
+        });
+    return pos ? &m_options[*pos] : nullptr;
+  }
+  auto option = std::find(m_options.crbegin(), m_options.crend(), key);
+  if (option == m_options.crend())
+    return nullptr;
+  return &(*option);
+}
+
+//******************************************************************************
+void InputBlock::push_option(Option option) {
+  materialize();
+  m_version.bump();
+  m_options.push_back(std::move(option));
+  m_cache.emplace_back();
+  if (m_hash.valid())
+    m_hash.add_option(m_options.size() - 1, option_hash(m_options.back()));
+#if defined(USERIO_TELEMETRY)
+  m_telemetry.add_option();
+#endif
+  const auto key_of = [this](std::size_t i) -> std::string_view {
+    return m_options[i].key;
+  };
+  if (!m_option_index.empty())
+    m_option_index.insert(m_options.size() - 1, key_of);
+  else if (m_options.size() > index_threshold)
+    m_option_index.build(m_options.size(), key_of);
+}
+
+InputBlock &InputBlock::push_block(InputBlock block) {
+  materialize();
+  m_version.bump();
+  auto &new_block = m_blocks.emplace_back(std::move(block));
+  if (m_hash.valid())
+    m_hash.add_block(m_blocks.size() - 1, new_block.hash());
+  const auto key_of = [this](std::size_t i) -> std::string_view {
+    return m_blocks[i].m_name;
+  };
+  if (!m_block_index.empty())
+    m_block_index.insert(m_blocks.size() - 1, key_of);
+  else if (m_blocks.size() > index_threshold)
+    m_block_index.build(m_blocks.size(), key_of);
+  return new_block;
+}
+
+void InputBlock::reindex() {
+  materialize();
+  m_version.bump();
+  m_cache.assign(m_options.size(), ValueCache{});
+  m_hash.invalidate();
+#if defined(USERIO_TELEMETRY)
+  m_telemetry.reset_options(m_options.size());
+#endif
+  m_option_index.clear();
+  m_block_index.clear();
+  if (m_options.size() > index_threshold)
+    m_option_index.build(m_options.size(),
+                         [this](std::size_t i) -> std::string_view {
+                           return m_options[i].key;
+                         });
+  if (m_blocks.size() > index_threshold)
+    m_block_index.build(m_blocks.size(),
+                        [this](std::size_t i) -> std::string_view {
+                          return m_blocks[i].m_name;
+                        });
+}
+
 //******************************************************************************
 void InputBlock::consolidate() {
-  for (auto bl = m_blocks.end() - 1; bl != m_blocks.begin() - 1; --bl) {
-    bl->consolidate();
-    auto bl2 = std::find(m_blocks.begin(), bl, bl->name());
-    if (bl2 != bl) {
-      bl2->m_options.insert(bl2->m_options.end(), bl->m_options.cbegin(),
-                            bl->m_options.cend());
-      m_blocks.erase(bl);
+  // Single pass: blocks are grouped by name (hash map), in order of first
+  // appearance. Options and sub-blocks of repeated blocks are appended, in
+  // order, to the first; each group then has its sub-blocks merged in turn
+  materialize();
+  std::pmr::vector<InputBlock> merged(m_blocks.get_allocator());
+  merged.reserve(m_blocks.size()); // nb: keeps keys (views of names) valid
+  std::unordered_map<std::string_view, std::size_t> first;
+  first.reserve(m_blocks.size());
+  for (auto &block : m_blocks) {
+    block.materialize();
+    const auto existing = first.find(block.m_name);
+    if (existing == first.end()) {
+      merged.push_back(std::move(block));
+      first.emplace(merged.back().m_name, merged.size() - 1);
+      continue;
     }
+    auto &target = merged[existing->second];
+    std::move(block.m_options.begin(), block.m_options.end(),
+              std::back_inserter(target.m_options));
+    std::move(block.m_blocks.begin(), block.m_blocks.end(),
+              std::back_inserter(target.m_blocks));
+  }
+  for (auto &block : merged)
+    block.consolidate();
+  m_blocks = std::move(merged);
+  reindex();
+}
+
+detail::TreeStats InputBlock::tree_stats() const {
+  // nb: unparsed lazy blocks have no options/blocks yet (not parsed here)
+  detail::TreeStats stats{
+      m_options.size() + m_blocks.size(),
+      m_options.capacity() * sizeof(Option) +
+          m_blocks.capacity() * sizeof(InputBlock) + m_name.size()};
+  for (const auto &option : m_options)
+    stats.memory += option.key.size() + option.value_str.size();
+  for (const auto &block : m_blocks) {
+    const auto block_stats = block.tree_stats();
+    stats.nodes += block_stats.nodes;
+    stats.memory += block_stats.memory;
+  }
+  return stats;
+}
+
+void InputBlock::merge_into(InputBlock &child, InputBlock &&other) {
+  if (!m_hash.valid()) {
+    child.merge_from(std::move(other));
+    return;
+  }
+  const auto i = std::size_t(&child - m_blocks.data());
+  const auto old_hash = child.hash();
+  child.merge_from(std::move(other));
+  m_hash.replace_block(i, old_hash, child.hash());
+}
+
+void InputBlock::merge_from(InputBlock &&other) {
+  other.materialize();
+  for (auto &option : other.m_options)
+    push_option(std::move(option));
+  for (auto &block : other.m_blocks) {
+    if (auto existing = getBlock_ptr(block.m_name))
+      merge_into(*existing, std::move(block));
+    else
+      push_block(std::move(block));
   }
 }
 
 //******************************************************************************
+// Builds the tree in one pass. Blocks are first numbered in order of
+// appearance; they are then re-ordered (counting sort, by parent) so that
+// each node's children are contiguous, and options sorted by owner.
+class InputTree::Builder {
+public:
+  Builder(InputTree *tree, std::string_view name, std::size_t size_hint)
+      : m_tree(tree),
+        m_resource(tree->m_text_store.get_allocator().resource()),
+        m_names(m_resource),
+        m_parent(m_resource),
+        m_owner(m_resource),
+        m_stack(m_resource) {
+    m_tree->m_text_store.reserve(size_hint + name.size());
+    m_parent.push_back(none);
+    m_names.push_back(append(name));
+    m_stack.push_back(0);
+  }
+
+  void on_option(std::string_view key, std::string_view value) {
+    check_count(m_tree->m_entry_store.size(), "options");
+    m_tree->m_entry_store.push_back({append(key), append(value)});
+    m_owner.push_back(m_stack.back());
+  }
+  void on_block_begin(std::string_view name) {
+    check_count(m_names.size(), "blocks");
+    m_parent.push_back(m_stack.back());
+    m_names.push_back(append(name));
+    m_stack.push_back(std::uint32_t(m_names.size() - 1));
+  }
+  void on_block_end() { m_stack.pop_back(); }
+
+  void finish() {
+    const auto num_nodes = m_names.size();
+    // Counting sort of nodes by parent (root first: parent+1 == 0)
+    std::pmr::vector<std::uint32_t> start(num_nodes + 2, 0, m_resource);
+    for (const auto parent : m_parent)
+      ++start[parent + 2]; // nb: none+2 == 1
+    for (std::size_t i = 1; i < start.size(); ++i)
+      start[i] += start[i - 1];
+    // start[p+1] is now position of first child of node p
+    std::pmr::vector<std::uint32_t> new_index(num_nodes, m_resource);
+    {
+      std::pmr::vector<std::uint32_t> next(start, m_resource);
+      for (std::size_t i = 0; i < num_nodes; ++i)
+        new_index[i] = next[m_parent[i] + 1]++;
+    }
+
+    // Counting sort of options by owner
+    std::pmr::vector<std::uint32_t> ostart(num_nodes + 1, 0, m_resource);
+    for (const auto owner : m_owner)
+      ++ostart[owner + 1];
+    for (std::size_t i = 1; i < ostart.size(); ++i)
+      ostart[i] += ostart[i - 1];
+    {
+      std::pmr::vector<Entry> sorted(m_tree->m_entry_store.size(), m_resource);
+      std::pmr::vector<std::uint32_t> next(ostart, m_resource);
+      for (std::size_t i = 0; i < m_owner.size(); ++i)
+        sorted[next[m_owner[i]]++] = m_tree->m_entry_store[i];
+      m_tree->m_entry_store = std::move(sorted);
+    }
+
+    auto &nodes = m_tree->m_node_store;
+    nodes.assign(num_nodes, Node{});
+    for (std::size_t i = 0; i < num_nodes; ++i) {
+      auto &node = nodes[new_index[i]];
+      node.name = m_names[i];
+      node.first_option = ostart[i];
+      node.num_options = ostart[i + 1] - ostart[i];
+      node.first_child = start[i + 1];
+      node.num_children = start[i + 2] - start[i + 1];
+    }
+  }
+
+private:
+  static constexpr std::uint32_t none = std::uint32_t(-1);
+  InputTree *m_tree;
+  std::pmr::memory_resource *m_resource; // tree's; used for all scratch space
+  std::pmr::vector<Span> m_names;
+  std::pmr::vector<std::uint32_t> m_parent; // parent of each node
+  std::pmr::vector<std::uint32_t> m_owner;  // node that owns each option
+  std::pmr::vector<std::uint32_t> m_stack;  // currently open nodes
+
+  // Indices are 32-bit, and 'none' is reserved: 'count' more must fit
+  static void check_count(std::size_t count, const char *what) {
+    if (count >= none - 1)
+      throw std::length_error(std::string("InputTree: too many ") + what);
+  }
+
+  Span append(std::string_view str) {
+    auto &text = m_tree->m_text_store;
+    if (str.size() > std::size_t(none) - text.size())
+      throw std::length_error("InputTree: text exceeds 4 GiB");
+    const Span span{std::uint32_t(text.size()), std::uint32_t(str.size())};
+    text += str;
+    return span;
+  }
+};
+
 //******************************************************************************
+void InputTree::parse(std::string_view name, std::string_view text) {
+  detail::PhaseTrace trace("parse", text.size(), [this] {
+    // nb: outer-most block not counted (as for InputBlock)
+    const auto blocks = m_node_store.empty() ? 0 : m_node_store.size() - 1;
+    return detail::TreeStats{blocks + m_entry_store.size(), memory()};
+  });
+  Builder builder(this, name, text.size());
+  Lexer lexer(builder);
+  lexer.feed(text);
+  lexer.finish();
+  builder.finish();
+  attach();
+}
+
+InputTree &InputTree::operator=(const InputTree &other) {
+  if (this == &other)
+    return *this;
+  m_text_store = other.m_text_store;
+  m_node_store = other.m_node_store;
+  m_entry_store = other.m_entry_store;
+  m_snapshot = other.m_snapshot;
+  attach_from(other);
+  return *this;
+}
+
+InputTree &InputTree::operator=(InputTree &&other) noexcept {
+  // nb: if memory resources differ, contents are moved element-wise
+  m_text_store = std::move(other.m_text_store);
+  m_node_store = std::move(other.m_node_store);
+  m_entry_store = std::move(other.m_entry_store);
+  m_snapshot = std::move(other.m_snapshot);
+  attach_from(other);
+  return *this;
+}
+
 //******************************************************************************
+std::uint64_t InputTree::checksum(std::string_view name,
+                                  std::string_view text) {
+  // 64-bit FNV-1a
+  std::uint64_t hash = 0xcbf29ce484222325ull;
+  const auto add = [&hash](std::string_view str) {
+    for (const auto c : str) {
+      hash ^= static_cast<unsigned char>(c);
+      hash *= 0x100000001b3ull;
+    }
+  };
+  add(name);
+  add(std::string_view("\0", 1));
+  add(text);
+  return hash;
+}
+
+bool InputTree::writeSnapshot(const std::string &filename,
+                              std::uint64_t source_checksum) const {
+  Header header{};
+  std::copy(std::begin(snapshot_magic), std::end(snapshot_magic),
+            header.magic);
+  header.format_version = snapshot_version;
+  header.byte_order = byte_order_mark;
+  header.source_checksum = source_checksum;
+  header.num_nodes = m_num_nodes;
+  header.num_entries = m_num_entries;
+  header.text_size = m_text.size();
+
+  // Unique per process and thread, in the same directory (rename is atomic)
+  static std::atomic<std::uint64_t> counter{0};
+  std::ostringstream temp_name;
+  temp_name << filename << ".tmp."
+#if defined(USERIO_HAVE_MMAP)
+            << ::getpid() << '.'
+#endif
+            << std::hash<std::thread::id>{}(std::this_thread::get_id()) << '.'
+            << counter++;
+  const auto temp_filename = temp_name.str();
+
+  std::ofstream file(temp_filename, std::ios::binary | std::ios::trunc);
+  file.write(reinterpret_cast<const char *>(&header), sizeof(Header));
+  file.write(reinterpret_cast<const char *>(m_nodes),
+             std::streamsize(m_num_nodes * sizeof(Node)));
+  file.write(reinterpret_cast<const char *>(m_entries),
+             std::streamsize(m_num_entries * sizeof(Entry)));
+  file.write(m_text.data(), std::streamsize(m_text.size()));
+  file.close();
+  if (!file || std::rename(temp_filename.c_str(), filename.c_str()) != 0) {
+    std::remove(temp_filename.c_str());
+    return false;
+  }
+  return true;
+}
+
+std::optional<InputTree>
+InputTree::loadSnapshot(const std::string &filename,
+                        std::optional<std::uint64_t> source_checksum) {
+  auto file = std::make_shared<const MappedFile>(filename);
+  const auto data = file->view();
+  if (!*file || data.size() < sizeof(Header))
+    return std::nullopt;
+  Header header;
+  std::memcpy(&header, data.data(), sizeof(Header));
+  if (!std::equal(std::begin(snapshot_magic), std::end(snapshot_magic),
+                  header.magic) ||
+      header.format_version != snapshot_version ||
+      header.byte_order != byte_order_mark || header.num_nodes == 0)
+    return std::nullopt;
+  if (source_checksum && *source_checksum != header.source_checksum)
+    return std::nullopt;
+  // nb: sizes checked one at a time, so the offsets cannot overflow
+  const auto payload = data.size() - sizeof(Header);
+  if (header.num_nodes > payload / sizeof(Node) ||
+      header.num_entries > payload / sizeof(Entry) ||
+      header.text_size > payload)
+    return std::nullopt;
+  const auto nodes_offset = sizeof(Header);
+  const auto entries_offset = nodes_offset + header.num_nodes * sizeof(Node);
+  const auto text_offset = entries_offset + header.num_entries * sizeof(Entry);
+  if (text_offset + header.text_size != data.size())
+    return std::nullopt;
+
+  // Every index and span must be in range (a corrupt or foreign file must
+  // not crash the reader), children must come after their parent, and the
+  // child (option) ranges must partition the nodes after the root (the
+  // entries): so each node has exactly one parent, and the tree has no cycles
+  // and no shared sub-trees (which would make walking it exponential).
+  // O(size), but no parsing
+  const auto nodes = reinterpret_cast<const Node *>(data.data() + nodes_offset);
+  const auto entries =
+      reinterpret_cast<const Entry *>(data.data() + entries_offset);
+  const auto span_ok = [&header](Span span) {
+    return std::uint64_t(span.begin) + span.size <= header.text_size;
+  };
+  // Marks [first, first+count) as used; false if any already was
+  const auto claim = [](std::vector<bool> &used, std::uint32_t first,
+                        std::uint32_t count) {
+    for (auto j = std::size_t(first); j < std::size_t(first) + count; ++j) {
+      if (used[j])
+        return false;
+      used[j] = true;
+    }
+    return true;
+  };
+  std::vector<bool> has_parent(header.num_nodes, false);
+  std::vector<bool> has_owner(header.num_entries, false);
+  std::uint64_t num_children = 0, num_options = 0;
+  for (std::uint64_t i = 0; i < header.num_nodes; ++i) {
+    const auto &node = nodes[i];
+    if (!span_ok(node.name) ||
+        std::uint64_t(node.first_option) + node.num_options >
+            header.num_entries ||
+        std::uint64_t(node.first_child) + node.num_children >
+            header.num_nodes ||
+        (node.num_children > 0 && node.first_child <= i) ||
+        !claim(has_parent, node.first_child, node.num_children) ||
+        !claim(has_owner, node.first_option, node.num_options))
+      return std::nullopt;
+    num_children += node.num_children;
+    num_options += node.num_options;
+  }
+  if (num_children != header.num_nodes - 1 ||
+      num_options != header.num_entries)
+    return std::nullopt;
+  for (std::uint64_t i = 0; i < header.num_entries; ++i) {
+    if (!span_ok(entries[i].key) || !span_ok(entries[i].value))
+      return std::nullopt;
+  }
+
+  // "Relocation": just point the views into the mapped file
+  InputTree tree;
+  tree.m_text_store = {};
+  tree.m_node_store = {};
+  tree.m_entry_store = {};
+  tree.m_nodes = nodes;
+  tree.m_num_nodes = header.num_nodes;
+  tree.m_entries = entries;
+  tree.m_num_entries = header.num_entries;
+  tree.m_text = data.substr(text_offset, header.text_size);
+  tree.m_snapshot = std::move(file);
+  return tree;
+}
+
+InputTree InputTree::fromFileCached(std::string_view name,
+                                    const std::string &filename,
+                                    const std::string &snapshot_filename) {
+  const MappedFile file(filename);
+  const auto source_checksum = checksum(name, file.view());
+  if (auto tree = loadSnapshot(snapshot_filename, source_checksum))
+    return std::move(*tree);
+  InputTree tree(name, file.view());
+  // nb: the snapshot is only a cache: failing to write it is not an error
+  static_cast<void>(tree.writeSnapshot(snapshot_filename, source_checksum));
+  return tree;
+}
+
+InputTree InputTree::fromFile(std::string_view name,
+                              const std::string &filename,
+                              std::pmr::memory_resource *resource) {
+  const MappedFile file(filename);
+  return InputTree(name, file.view(), resource);
+}
+
+InputTree::BlockView InputTree::root() const { return {this, 0}; }
+
+InputBlock InputTree::toInputBlock() const { return root().toInputBlock(); }
+
+void InputTree::to_input_block(std::uint32_t index, InputBlock &block) const {
+  const auto &node = m_nodes[index];
+  for (auto i = node.first_option; i < node.first_option + node.num_options;
+       ++i) {
+    block.add(Option(text(m_entries[i].key), text(m_entries[i].value),
+                     block.get_allocator()));
+  }
+  for (auto i = node.first_child; i < node.first_child + node.num_children;
+       ++i) {
+    InputBlock child(text(m_nodes[i].name), {}, block.get_allocator());
+    to_input_block(i, child);
+    block.add(std::move(child));
+  }
+}
 
 //******************************************************************************
-inline std::string removeSpaces(std::string lines) {
+std::optional<InputTree::BlockView>
+InputTree::BlockView::getBlock(std::string_view name) const {
+  // Search backwards: later blocks override earlier ones
+  for (auto i = num_blocks(); i-- > 0;) {
+    const auto child = block(i);
+    if (child.name() == name)
+      return child;
+  }
+  return std::nullopt;
+}
 
-  // remove spaces
-  lines.erase(std::remove_if(lines.begin(), lines.end(),
-                             [](unsigned char x) { return x == ' '; }),
-              lines.end());
-  // remove tabs
-  lines.erase(std::remove_if(lines.begin(), lines.end(),
-                             [](unsigned char x) { return x == '\t'; }),
-              lines.end());
-  // remove newlines
-  lines.erase(std::remove_if(lines.begin(), lines.end(),
-                             [](unsigned char x) { return x == '\n'; }),
-              lines.end());
+std::optional<InputTree::BlockView> InputTree::BlockView::getBlock(
+    std::initializer_list<std::string_view> blocks) const {
+  std::optional<BlockView> block = *this;
+  for (const auto &name : blocks) {
+    block = block->getBlock(name);
+    if (!block)
+      return std::nullopt;
+  }
+  return block;
+}
 
-  // remove ' and "
-  lines.erase(std::remove_if(lines.begin(), lines.end(),
-                             [](unsigned char x) { return x == '\''; }),
-              lines.end());
+std::optional<InputTree::OptionView>
+InputTree::BlockView::findOption(std::string_view key) const {
+  // Search backwards: later options override earlier ones
+  for (auto i = num_options(); i-- > 0;) {
+    const auto opt = option(i);
+    if (opt.key == key)
+      return opt;
+  }
+  return std::nullopt;
+}
+
+//******************************************************************************
+template <typename KeyOf>
+void KeyIndex::build(std::size_t size, KeyOf key_of) {
+  std::size_t capacity = 16;
+  while (capacity < 2 * size)
+    capacity *= 2;
+  m_slots.assign(capacity, Slot{});
+  m_count = 0;
+  for (std::size_t i = 0; i < size; ++i)
+    insert(i, key_of);
+}
+
+template <typename KeyOf>
+void KeyIndex::insert(std::size_t pos, KeyOf key_of) {
+  // nb: pos+1 is stored (0 marks an empty slot), so it must not wrap
+  if (pos >= std::size_t(std::uint32_t(-1)))
+    throw std::length_error("KeyIndex: too many entries");
+  if (2 * (m_count + 1) > m_slots.size()) {
+    // nb: build() re-inserts all entries up to and including pos
+    build(pos + 1, key_of);
+    return;
+  }
+  const auto key = key_of(pos);
+  const auto h = hash(key);
+  const auto mask = m_slots.size() - 1;
+  for (auto i = h & mask;; i = (i + 1) & mask) {
+    auto &slot = m_slots[i];
+    if (slot.pos_plus1 == 0) {
+      slot = {h, std::uint32_t(pos + 1)};
+      ++m_count;
+      return;
+    }
+    if (slot.hash == h && key_of(slot.pos_plus1 - 1) == key) {
+      // Same key: later entry overrides earlier one
+      slot.pos_plus1 = std::uint32_t(pos + 1);
+      return;
+    }
+  }
+}
+
+template <typename KeyOf>
+std::optional<std::size_t> KeyIndex::find(std::string_view key,
+                                          KeyOf key_of) const {
+  if (m_slots.empty())
+    return std::nullopt;
+  const auto h = hash(key);
+  const auto mask = m_slots.size() - 1;
+  for (auto i = h & mask;; i = (i + 1) & mask) {
+    const auto &slot = m_slots[i];
+    if (slot.pos_plus1 == 0)
+      return std::nullopt;
+    if (slot.hash == h && key_of(slot.pos_plus1 - 1) == key)
+      return slot.pos_plus1 - 1;
+  }
+}
+
+//******************************************************************************
+//******************************************************************************
+//******************************************************************************
+
+//******************************************************************************
+template <typename Handler> void Lexer<Handler>::feed(std::string_view chunk) {
+  if (m_stopped)
+    return;
+  detail::SpecialScanner scanner(chunk);
+  for (std::size_t i = 0; i < chunk.size(); ++i) {
+    // Jump to next special character (appending everything before it to the
+    // token). Except just after '/' or '*': there, any character matters
+    if (m_state != State::Slash && m_state != State::BlockStar) {
+      const auto next = scanner.next(i);
+      if (m_state == State::Normal && m_skip == 0)
+        m_token.append(chunk.data() + i, next - i);
+      i = next;
+      if (i == chunk.size())
+        break;
+    }
+    const char c = chunk[i];
+    if (c == '\n') {
+      ++m_line;
+      m_line_start = m_offset + i + 1;
+    }
+    switch (m_state) {
+    case State::LineComment:
+      if (c == '\n')
+        m_state = State::Normal;
+      continue;
+    case State::BlockComment:
+      if (c == '*')
+        m_state = State::BlockStar;
+      continue;
+    case State::BlockStar:
+      m_state = c == '/' ? State::Normal
+                : c == '*' ? State::BlockStar
+                           : State::BlockComment;
+      continue;
+    case State::Slash:
+      if (c == '/') {
+        m_state = State::LineComment;
+        continue;
+      }
+      if (c == '*') {
+        m_state = State::BlockComment;
+        continue;
+      }
+      // Lone '/' is part of the token; 'c' is then lexed as normal
+      m_token += '/';
+      m_state = State::Normal;
+      break;
+    case State::Normal:
+      break;
+    }
+
+    switch (c) {
+    case ' ':
+    case '\t':
+    case '\n':
+    case '\'':
+    case '\"':
+      break;
+    case '!':
+    case '#':
+      m_state = State::LineComment;
+      break;
+    case '/':
+      m_state = State::Slash;
+      break;
+    case ';':
+      if (m_skip == 0)
+        emit_option();
+      break;
+    case '{':
+      if (m_skip > 0) {
+        ++m_skip;
+        break;
+      }
+      m_at = m_offset + i;
+      m_open.push_back({m_line, m_at - m_line_start + 1});
+      notify([&] { return m_handler.on_block_begin(m_token); });
+      m_token.clear();
+      break;
+    case '}':
+      // An option not terminated by ';' before the '}' is discarded
+      m_token.clear();
+      if (m_skip > 1) {
+        --m_skip;
+        break;
+      }
+      m_skip = 0;
+      m_at = m_offset + i;
+      if (m_open.empty()) {
+        *m_errors << "ERROR in InputBlock: unmatched '}' at " << m_line << ':'
+                  << m_offset + i - m_line_start + 1
+                  << " - ignored. Check balanced {} in input\n";
+        break;
+      }
+      m_open.pop_back();
+      notify([&] { return m_handler.on_block_end(); });
+      break;
+    default:
+      m_token += c;
+    }
+    if (m_stopped)
+      return;
+  }
+  m_offset += chunk.size();
+}
+
+template <typename Handler> void Lexer<Handler>::finish() {
+  if (m_stopped) {
+    m_token.clear();
+    return;
+  }
+  m_skip = 0;
+  m_at = m_offset;
+  if (!m_open.empty()) {
+    const auto &[line, column] = m_open.back();
+    *m_errors << "ERROR in InputBlock: " << m_open.size()
+              << " unclosed '{' at end of input; innermost opened at " << line
+              << ':' << column << ". Check balanced {} in input\n";
+  }
+  for (; !m_open.empty() && !m_stopped; m_open.pop_back())
+    notify([&] { return m_handler.on_block_end(); });
+  m_state = State::Normal;
+  m_token.clear();
+}
+
+template <typename Handler> void Lexer<Handler>::emit_option() {
+  // Empty options (e.g., ';;') are ignored
+  if (!m_token.empty()) {
+    const std::string_view token = m_token;
+    const auto pos = token.find('=');
+    const auto key = token.substr(0, pos);
+    const auto value =
+        pos < token.length() ? token.substr(pos + 1) : std::string_view{};
+    notify([&] { return m_handler.on_option(key, value); });
+  }
+  m_token.clear();
+}
+
+template <typename Handler>
+template <typename F>
+void Lexer<Handler>::notify(F &&callback) {
+  if constexpr (std::is_void_v<decltype(callback())>) {
+    callback();
+  } else {
+    if (!callback())
+      m_stopped = true;
+  }
+}
+
+//******************************************************************************
+template <typename Handler>
+bool parse_input(const std::istream &input, Handler &handler,
+                 std::size_t chunk_size) {
+  Lexer lexer(handler);
+  if (input) {
+    std::vector<char> buffer(std::max<std::size_t>(chunk_size, 1));
+    const auto read = [&] {
+      return input.rdbuf()->sgetn(buffer.data(),
+                                  std::streamsize(buffer.size()));
+    };
+    for (auto n = read(); n > 0 && !lexer.stopped(); n = read())
+      lexer.feed({buffer.data(), std::size_t(n)});
+  }
+  lexer.finish();
+  return !lexer.stopped();
+}
+
+template <typename Handler>
+bool parse_input(std::string_view input, Handler &handler) {
+  Lexer lexer(handler);
+  lexer.feed(input);
+  lexer.finish();
+  return !lexer.stopped();
+}
+
+//******************************************************************************
+std::vector<detail::Section> detail::split_top_level(std::string_view text,
+                                                     std::size_t min_size) {
+  // Cut-down version of the Lexer: only tracks comments and brace depth
+  enum class State { Normal, Slash, LineComment, BlockComment, BlockStar };
+  auto state = State::Normal;
+  std::size_t depth = 0;
+  std::size_t line = 1, line_start = 0;
+  std::vector<Section> sections;
+  Section current{text.substr(0, 0), 1, 1};
+  std::size_t begin = 0;
+  SpecialScanner scanner(text);
+  for (std::size_t i = 0; i < text.size(); ++i) {
+    // Only special characters matter (except just after '/' or '*')
+    if (state != State::Slash && state != State::BlockStar) {
+      i = scanner.next(i);
+      if (i == text.size())
+        break;
+    }
+    const char c = text[i];
+    if (c == '\n') {
+      ++line;
+      line_start = i + 1;
+    }
+    switch (state) {
+    case State::LineComment:
+      if (c == '\n')
+        state = State::Normal;
+      continue;
+    case State::BlockComment:
+      if (c == '*')
+        state = State::BlockStar;
+      continue;
+    case State::BlockStar:
+      state = c == '/'   ? State::Normal
+              : c == '*' ? State::BlockStar
+                         : State::BlockComment;
+      continue;
+    case State::Slash:
+      state = State::Normal;
+      if (c == '/') {
+        state = State::LineComment;
+        continue;
+      }
+      if (c == '*') {
+        state = State::BlockComment;
+        continue;
+      }
+      break;
+    case State::Normal:
+      break;
+    }
+    bool boundary = false;
+    switch (c) {
+    case '!':
+    case '#':
+      state = State::LineComment;
+      break;
+    case '/':
+      state = State::Slash;
+      break;
+    case '{':
+      ++depth;
+      break;
+    case '}':
+      // nb: unmatched '}' is left for the Lexer to report
+      if (depth > 0)
+        --depth;
+      boundary = depth == 0;
+      break;
+    case ';':
+      boundary = depth == 0;
+      break;
+    }
+    if (boundary && i + 1 - begin >= min_size) {
+      current.text = text.substr(begin, i + 1 - begin);
+      sections.push_back(current);
+      begin = i + 1;
+      // location of next section
+      current.line = line;
+      current.column = begin - line_start + 1;
+    }
+  }
+  if (begin < text.size()) {
+    current.text = text.substr(begin);
+    sections.push_back(current);
+  }
+  return sections;
+}
+
+//******************************************************************************
+namespace detail {
+struct SpecialTable {
+  bool v[256];
+  constexpr SpecialTable() : v{} {
+    for (char c : special_chars)
+      v[static_cast<unsigned char>(c)] = true;
+  }
+};
+inline constexpr SpecialTable special_table{};
+
+inline std::uint64_t special_mask_scalar(const char *p, std::size_t n) {
+  std::uint64_t mask = 0;
+  for (std::size_t i = 0; i < n; ++i) {
+    mask |= std::uint64_t{special_table.v[static_cast<unsigned char>(p[i])]}
+            << i;
+  }
+  return mask;
+}
+
+#if defined(USERIO_HAVE_SSE2)
+inline std::uint64_t special_mask64_sse2(const char *p) {
+  std::uint64_t mask = 0;
+  for (int k = 0; k < 4; ++k) {
+    const auto v =
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + 16 * k));
+    auto eq = _mm_setzero_si128();
+    for (char c : special_chars)
+      eq = _mm_or_si128(eq, _mm_cmpeq_epi8(v, _mm_set1_epi8(c)));
+    mask |= std::uint64_t(static_cast<std::uint32_t>(_mm_movemask_epi8(eq)))
+            << (16 * k);
+  }
+  return mask;
+}
+#endif
+
+#if defined(USERIO_HAVE_AVX2)
+__attribute__((target("avx2"))) inline std::uint64_t
+special_mask64_avx2(const char *p) {
+  std::uint64_t mask = 0;
+  for (int k = 0; k < 2; ++k) {
+    const auto v =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p + 32 * k));
+    auto eq = _mm256_setzero_si256();
+    for (char c : special_chars)
+      eq = _mm256_or_si256(eq, _mm256_cmpeq_epi8(v, _mm256_set1_epi8(c)));
+    mask |= std::uint64_t(static_cast<std::uint32_t>(_mm256_movemask_epi8(eq)))
+            << (32 * k);
+  }
+  return mask;
+}
+#endif
+
+inline std::uint64_t special_mask64(const char *p) {
+#if defined(USERIO_HAVE_AVX2) && defined(__AVX2__)
+  return special_mask64_avx2(p);
+#elif defined(USERIO_HAVE_AVX2)
+  static const bool avx2 = __builtin_cpu_supports("avx2");
+  return avx2 ? special_mask64_avx2(p) : special_mask64_sse2(p);
+#elif defined(USERIO_HAVE_SSE2)
+  return special_mask64_sse2(p);
+#else
+  return special_mask_scalar(p, 64);
+#endif
+}
+
+inline unsigned count_trailing_zeros(std::uint64_t x) {
+#if defined(__GNUC__) || defined(__clang__)
+  return static_cast<unsigned>(__builtin_ctzll(x));
+#else
+  unsigned n = 0;
+  for (; (x & 1) == 0; x >>= 1)
+    ++n;
+  return n;
+#endif
+}
+
+std::size_t SpecialScanner::next(std::size_t i) {
+  while (i < m_text.size()) {
+    const auto block = i - i % 64;
+    if (block != m_block) {
+      const auto n = std::min<std::size_t>(64, m_text.size() - block);
+      m_mask = n == 64 ? special_mask64(m_text.data() + block)
+                       : special_mask_scalar(m_text.data() + block, n);
+      m_block = block;
+    }
+    const auto mask = m_mask & (~std::uint64_t{0} << (i - block));
+    if (mask != 0)
+      return block + count_trailing_zeros(mask);
+    i = block + 64;
+  }
+  return m_text.size();
+}
+} // namespace detail
+
+//******************************************************************************
+inline std::string removeSpaces(std::string lines) {
+  // remove spaces, tabs, newlines, and ' and " (single pass)
   lines.erase(std::remove_if(lines.begin(), lines.end(),
-                             [](unsigned char x) { return x == '\"'; }),
+                             [](unsigned char x) {
+                               return x == ' ' || x == '\t' || x == '\n' ||
+                                      x == '\'' || x == '\"';
+                             }),
               lines.end());
-
   return lines;
 }
 
 //******************************************************************************
 inline void removeBlockComments(std::string &input) {
-  for (auto posi = input.find("/*"); posi != std::string::npos;
-       posi = input.find("/*")) {
-    auto posf = input.find("*/");
-    if (posf != std::string::npos) {
-      input = input.substr(0, posi) + input.substr(posf + 2);
+  // Copy everything outside of /* */ to front of string, in one pass
+  std::size_t out = 0;
+  for (std::size_t pos = 0; pos < input.size();) {
+    const auto posi = input.find("/*", pos);
+    const auto len = std::min(posi, input.size()) - pos;
+    input.replace(out, len, input, pos, len);
+    out += len;
+    if (posi == std::string::npos)
+      break;
+    const auto posf = input.find("*/", posi + 2);
+    pos = posf == std::string::npos ? input.size() : posf + 2;
+  }
+  input.resize(out);
+}
+
+//******************************************************************************
+inline std::string removeComments(const std::string &input) {
+  std::string lines;
+  lines.reserve(input.size() + 1);
+  const std::string_view view = input;
+  for (std::size_t pos = 0; pos < view.size();) {
+    const auto eol = std::min(view.find('\n', pos), view.size());
+    const auto line = view.substr(pos, eol - pos);
+    auto comm1 = line.find('!'); // nb: char, NOT string literal!
+    auto comm2 = line.find('#');
+    auto comm3 = line.find("//"); // str literal here
+    auto comm = std::min(comm1, std::min(comm2, comm3));
+    lines += line.substr(0, comm);
+    lines += '\n';
+    pos = eol + 1;
+  }
+  removeBlockComments(lines);
+
+  return lines;
+}
+
+//******************************************************************************
+template <typename T>
+std::optional<T> parse_value(std::string_view value_str, bool strict) {
+  if constexpr (IsVector<T>::v) {
+    // special case; allows return of std::vector (for comma-separated list
+    // input). Optional of vector is kind of redundant, but is this way so it
+    // aligns with the other functions (checks if optional is empty when
+    // deciding if should return the default value)
+    if (value_str == "")
+      return std::nullopt;
+    T out;
+    if (!parse_list(value_str, out, strict))
+      return std::nullopt;
+    return out;
+  } else {
+    if (value_str == "default" || value_str == "")
+      return std::nullopt;
+    if (strict)
+      return try_parse_str_to_T<T>(value_str);
+    return parse_str_to_T<T>(value_str);
+  }
+}
+
+//******************************************************************************
+inline std::size_t list_size(std::string_view list) {
+  return list.empty() ? 0 : 1 + std::size_t(std::count(list.begin(), list.end(), ','));
+}
+
+namespace detail {
+// Parses list elements into out[0,1,...]. Returns false if strict and any
+// element is invalid
+template <typename T>
+bool parse_list_serial(std::string_view list, T *out, bool strict) {
+  bool ok = true;
+  for (std::size_t start = 0;; ++out) {
+    const auto end = std::min(list.find(',', start), list.size());
+    const auto element = list.substr(start, end - start);
+    if (strict) {
+      auto value = try_parse_str_to_T<T>(element);
+      ok = ok && value;
+      *out = value ? std::move(*value) : T{};
     } else {
-      input = input.substr(0, posi);
+      *out = parse_str_to_T<T>(element);
+    }
+    if (end == list.size())
+      return ok;
+    start = end + 1;
+  }
+}
+} // namespace detail
+
+template <typename T>
+bool parse_list(std::string_view list, std::vector<T> &out, bool strict) {
+  out.clear();
+  if (list.empty())
+    return true;
+  if constexpr (std::is_same_v<T, bool>) {
+    // std::vector<bool> has no data(); parse element by element
+    bool ok = true;
+    for (std::size_t start = 0;;) {
+      const auto end = std::min(list.find(',', start), list.size());
+      const auto element = list.substr(start, end - start);
+      if (strict) {
+        const auto value = try_parse_str_to_T<bool>(element);
+        ok = ok && value;
+        out.push_back(value.value_or(false));
+      } else {
+        out.push_back(parse_str_to_T<bool>(element));
+      }
+      if (end == list.size())
+        return ok;
+      start = end + 1;
     }
+  } else {
+    out.resize(list_size(list));
+    return parse_list(list, out.data(), strict);
+  }
+}
+
+template <typename T> bool parse_list(std::string_view list, T *out, bool strict) {
+  if (list.empty())
+    return true;
+  if (list.size() < parallel_list_threshold)
+    return detail::parse_list_serial(list, out, strict);
+  auto &pool = detail::ThreadPool::shared();
+  const auto num_threads = std::min(
+      pool.size(), unsigned(list.size() / (parallel_list_threshold / 4)));
+  if (num_threads <= 1)
+    return detail::parse_list_serial(list, out, strict);
+
+  // Split list into chunks at ',' boundaries; number of elements in each
+  // chunk gives the position in 'out' where each chunk starts.
+  std::vector<std::string_view> chunks;
+  std::vector<std::size_t> first_element;
+  for (std::size_t begin = 0, count = 0; begin <= list.size();) {
+    auto end = std::min(list.find(',', begin + list.size() / num_threads),
+                        list.size());
+    const auto chunk = list.substr(begin, end - begin);
+    chunks.push_back(chunk);
+    first_element.push_back(count);
+    // nb: chunk may be blank (e.g., list ending in ','): still one element
+    count += 1 + std::size_t(std::count(chunk.begin(), chunk.end(), ','));
+    begin = end + 1;
   }
+
+  // nb: exceptions (e.g., from T's operator>>) are rethrown here
+  std::vector<char> ok(chunks.size(), true);
+  pool.run(chunks.size(), num_threads, [&](std::size_t i) {
+    ok[i] =
+        detail::parse_list_serial(chunks[i], out + first_element[i], strict);
+  });
+  return std::all_of(ok.cbegin(), ok.cend(), [](char x) { return x; });
 }
 
 //******************************************************************************
-inline std::string removeComments(const std::string &input) {
-  std::string lines = "";
+namespace detail {
+ThreadPool &ThreadPool::shared() {
+  static ThreadPool pool(std::max(std::thread::hardware_concurrency(), 1u) - 1);
+  return pool;
+}
+
+ThreadPool::ThreadPool(unsigned num_workers) {
+  for (unsigned i = 0; i < num_workers; ++i)
+    m_workers.emplace_back([this] { work(); });
+}
+
+ThreadPool::~ThreadPool() {
   {
-    std::string line;
-    std::stringstream stream1(input);
-    while (std::getline(stream1, line, '\n')) {
-      auto comm1 = line.find('!'); // nb: char, NOT string literal!
-      auto comm2 = line.find('#');
-      auto comm3 = line.find("//"); // str literal here
-      auto comm = std::min(comm1, std::min(comm2, comm3));
-      lines += line.substr(0, comm);
-      lines += '\n';
+    const std::lock_guard<std::mutex> lock(m_mutex);
+    m_stop = true;
+  }
+  m_wake.notify_all();
+  for (auto &worker : m_workers)
+    worker.join();
+}
+
+void ThreadPool::work() {
+  while (true) {
+    std::function<void()> job;
+    {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      m_wake.wait(lock, [this] { return m_stop || !m_jobs.empty(); });
+      if (m_jobs.empty())
+        return;
+      job = std::move(m_jobs.front());
+      m_jobs.pop_front();
     }
+    job();
   }
-  removeBlockComments(lines);
+}
 
-  return lines;
+template <typename Task>
+void ThreadPool::run(std::size_t n, unsigned max_threads, Task &&task) {
+  if (n == 0)
+    return;
+  // Shared with the helper jobs, which may start after run has returned (they
+  // then find no tasks left, so never touch 'task')
+  struct Batch {
+    std::atomic<std::size_t> next{0};
+    std::size_t done{0}; // guarded by mutex
+    std::mutex mutex{};
+    std::condition_variable finished{};
+    std::vector<std::exception_ptr> errors{};
+  };
+  const auto batch = std::make_shared<Batch>();
+  batch->errors.resize(n);
+  const auto drain = [batch, n, &task] {
+    std::size_t count = 0;
+    for (auto i = batch->next++; i < n; i = batch->next++, ++count) {
+      try {
+        task(i);
+      } catch (...) {
+        batch->errors[i] = std::current_exception();
+      }
+    }
+    if (count == 0)
+      return;
+    const std::lock_guard<std::mutex> lock(batch->mutex);
+    batch->done += count;
+    if (batch->done == n)
+      batch->finished.notify_all();
+  };
+
+  const auto helpers =
+      std::min({n, std::size_t(std::max(max_threads, 1u)), std::size_t(size())}) -
+      1;
+  if (helpers > 0) {
+    {
+      const std::lock_guard<std::mutex> lock(m_mutex);
+      for (std::size_t i = 0; i < helpers; ++i)
+        m_jobs.emplace_back(drain);
+    }
+    m_wake.notify_all();
+  }
+  drain();
+  {
+    std::unique_lock<std::mutex> lock(batch->mutex);
+    batch->finished.wait(lock, [&] { return batch->done == n; });
+  }
+  for (const auto &error : batch->errors) {
+    if (error)
+      std::rethrow_exception(error);
+  }
+}
+} // namespace detail
+
+//******************************************************************************
+namespace detail {
+// true for types converted with std::from_chars
+template <typename T>
+constexpr bool use_from_chars =
+    (std::is_integral_v<T> && !std::is_same_v<T, bool> &&
+     !std::is_same_v<T, char> && !std::is_same_v<T, signed char> &&
+     !std::is_same_v<T, unsigned char>) ||
+    std::is_floating_point_v<T>;
+
+// Parses the longest valid prefix of str as a number. Returns value, and
+// number of characters used (0 if str does not start with a number)
+template <typename T>
+std::pair<T, std::size_t> from_chars_prefix(std::string_view str) {
+  T value{};
+  auto first = str.data();
+  const auto last = str.data() + str.size();
+  // from_chars does not accept leading '+' (stringstream does)
+  if (first != last && *first == '+')
+    ++first;
+  if constexpr (std::is_integral_v<T> || defined_from_chars_fp) {
+    const auto [ptr, ec] = std::from_chars(first, last, value);
+    if (ec != std::errc{})
+      return {T{}, 0};
+    return {value, std::size_t(ptr - str.data())};
+  } else {
+    // Fallback for standard libraries without floating-point from_chars
+    const std::string tmp(first, last);
+    char *end = nullptr;
+    value = T(std::strtold(tmp.c_str(), &end));
+    if (end == tmp.c_str())
+      return {T{}, 0};
+    return {value, std::size_t(first - str.data()) +
+                       std::size_t(end - tmp.c_str())};
+  }
+}
+} // namespace detail
+
+//******************************************************************************
+inline std::optional<bool> parse_bool(std::string_view str) {
+  if (str == "True" || str == "true" || str == "Yes" || str == "yes" ||
+      str == "1" || str == "Y" || str == "y")
+    return true;
+  if (str == "False" || str == "false" || str == "No" || str == "no" ||
+      str == "0" || str == "N" || str == "n")
+    return false;
+  return std::nullopt;
 }
 
 //******************************************************************************
-template <typename T> T inline parse_str_to_T(const std::string &value_as_str) {
+template <typename T> T inline parse_str_to_T(std::string_view value_as_str) {
   if constexpr (std::is_same_v<T, std::string>) {
     // already a string, just return value
-    return value_as_str;
+    return std::string(value_as_str);
+  } else if constexpr (std::is_same_v<T, bool>) {
+    // Anything not recognised as 'true' is false
+    return parse_bool(value_as_str).value_or(false);
+  } else if constexpr (detail::use_from_chars<T>) {
+    // Fast path. Like stringstream, uses leading part of string that is a
+    // valid number (i.e., "1.5abc" -> 1.5); gives T{} if no number at all
+    return detail::from_chars_prefix<T>(value_as_str).first;
   } else {
-    // T is not a string: convert using stringstream
-    T value_T;
-    std::stringstream ss(value_as_str);
+    // Other types: convert using stringstream
+    T value_T{};
+    std::stringstream ss{std::string(value_as_str)};
     ss >> value_T;
     return value_T;
   }
 }
 
+template <typename T>
+std::optional<T> try_parse_str_to_T(std::string_view value_as_str) {
+  if constexpr (std::is_same_v<T, std::string>) {
+    return std::string(value_as_str);
+  } else if constexpr (std::is_same_v<T, bool>) {
+    return parse_bool(value_as_str);
+  } else if constexpr (detail::use_from_chars<T>) {
+    const auto [value, used] = detail::from_chars_prefix<T>(value_as_str);
+    if (used == 0 || used != value_as_str.size())
+      return std::nullopt;
+    return value;
+  } else {
+    T value_T{};
+    std::stringstream ss{std::string(value_as_str)};
+    if (!(ss >> value_T) || !(ss >> std::ws).eof())
+      return std::nullopt;
+    return value_T;
+  }
+}
+
+//******************************************************************************
+void StreamTracer::onPhase(const ParsePhase &phase) {
+  const std::lock_guard<std::mutex> lock(m_mutex);
+  const auto flags = m_os.flags();
+  const auto precision = m_os.precision();
+  if (m_format == Format::Json) {
+    m_os << "{\"phase\": \"" << phase.name << "\", \"seconds\": "
+         << std::scientific << std::setprecision(6) << phase.seconds
+         << ", \"bytes_in\": " << phase.bytes_in
+         << ", \"bytes_out\": " << phase.bytes_out
+         << ", \"nodes_in\": " << phase.nodes_in
+         << ", \"nodes_out\": " << phase.nodes_out
+         << ", \"memory\": " << phase.memory << "}\n";
+  } else {
+    m_os << std::left << std::setw(15) << phase.name << std::right
+         << std::fixed << std::setprecision(3) << std::setw(10)
+         << phase.seconds * 1.0e3 << " ms " << std::setw(12) << phase.bytes_in
+         << " bytes in " << std::setw(12) << phase.bytes_out << " bytes out "
+         << std::setw(9) << phase.nodes_in << " -> " << std::setw(9)
+         << phase.nodes_out << " nodes " << std::setw(12) << phase.memory
+         << " bytes memory\n";
+  }
+  m_os.flags(flags);
+  m_os.precision(precision);
+}
+
 //******************************************************************************
 inline std::string file_to_string(const std::istream &file) {
-  std::string out;
   if (!file)
     return "";
-  // Horribly inneficient...
-  std::ostringstream ss;
-  ss << file.rdbuf();
-  return ss.str();
+  detail::PhaseTrace trace("read", 0, [] { return detail::TreeStats{}; });
+  // Copy directly from the stream buffer (no intermediate stringstream)
+  std::string string(std::istreambuf_iterator<char>(file.rdbuf()),
+                     std::istreambuf_iterator<char>{});
+  trace.setBytesIn(string.size());
+  trace.setBytesOut(string.size());
+  trace.setMemory(string.capacity());
+  return string;
+}
+
+//******************************************************************************
+std::optional<std::string> read_file(const std::string &filename) {
+  std::filebuf file;
+  if (!file.open(filename, std::ios::in | std::ios::binary))
+    return std::nullopt;
+  detail::PhaseTrace trace("read", 0, [] { return detail::TreeStats{}; });
+  // Size is only a hint: unknown for pipes etc. (cannot seek), and the file
+  // may grow while being read. So read until end, growing as needed
+  std::size_t capacity = 1 << 16;
+  const auto end = file.pubseekoff(0, std::ios::end, std::ios::in);
+  if (end != std::streampos(-1)) {
+    if (file.pubseekoff(0, std::ios::beg, std::ios::in) != std::streampos(0))
+      return std::nullopt;
+    capacity = std::size_t(end) + 1; // +1: end is found without re-sizing
+  }
+  std::string text(capacity, '\0');
+  std::size_t size = 0;
+  while (true) {
+    if (size == text.size())
+      text.resize(2 * text.size());
+    const auto n =
+        file.sgetn(text.data() + size, std::streamsize(text.size() - size));
+    if (n <= 0)
+      break;
+    size += std::size_t(n);
+  }
+  text.resize(size);
+  trace.setBytesIn(size);
+  trace.setBytesOut(size);
+  trace.setMemory(text.capacity());
+  return text;
+}
+
+//******************************************************************************
+void MappedFile::open(const std::string &filename) {
+#ifdef USERIO_HAVE_MMAP
+  const int fd = ::open(filename.c_str(), O_RDONLY);
+  if (fd < 0)
+    return;
+  struct stat info;
+  const auto stat_ok = ::fstat(fd, &info) == 0;
+  if (stat_ok && S_ISDIR(info.st_mode)) {
+    ::close(fd);
+    return;
+  }
+  // Only regular files: size of pipes/FIFOs etc. is not known (fstat: 0)
+  const auto regular = stat_ok && S_ISREG(info.st_mode);
+  if (regular) {
+    // Copied bytes (bytes_out) are 0 if file is mapped
+    detail::PhaseTrace trace("read", 0, [] { return detail::TreeStats{}; });
+    m_size = std::size_t(info.st_size);
+    if (m_size > 0) {
+      void *data = ::mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (data != MAP_FAILED) {
+        ::madvise(data, m_size, MADV_SEQUENTIAL);
+        m_data = static_cast<const char *>(data);
+        m_mapped = true;
+      }
+    }
+    m_ok = m_mapped || m_size == 0;
+    trace.setBytesIn(m_ok ? m_size : 0);
+  } else if (stat_ok) {
+    // Pipe, FIFO, etc.: read from this descriptor until end (re-opening a
+    // FIFO would wait for a new writer)
+    detail::PhaseTrace trace("read", 0, [] { return detail::TreeStats{}; });
+    std::size_t size = 0;
+    m_buffer.resize(1 << 16);
+    while (true) {
+      if (size == m_buffer.size())
+        m_buffer.resize(2 * m_buffer.size());
+      const auto n = ::read(fd, m_buffer.data() + size, m_buffer.size() - size);
+      if (n < 0 && errno == EINTR)
+        continue;
+      if (n <= 0) {
+        m_ok = n == 0;
+        break;
+      }
+      size += std::size_t(n);
+    }
+    m_buffer.resize(m_ok ? size : 0);
+    m_data = m_buffer.data();
+    m_size = m_buffer.size();
+    trace.setBytesIn(m_size);
+    trace.setBytesOut(m_size);
+  }
+  ::close(fd);
+  if (m_ok)
+    return;
+  m_size = 0;
+  m_buffer.clear();
+  // nb: not re-opened unless a regular file (re-opening a FIFO by name would
+  // wait for a new writer)
+  if (!regular)
+    return;
+#endif
+  // Fallback (e.g., file could not be mapped): read into buffer
+  auto text = read_file(filename);
+  if (!text)
+    return;
+  m_buffer = std::move(*text);
+  m_data = m_buffer.data();
+  m_size = m_buffer.size();
+  m_ok = true;
+}
+
+void MappedFile::close() {
+#ifdef USERIO_HAVE_MMAP
+  if (m_mapped)
+    ::munmap(const_cast<char *>(m_data), m_size);
+#endif
+  m_mapped = false;
+}
+
+//******************************************************************************
+InputWatcher::InputWatcher(std::string_view name, std::string filename)
+    : m_name(name), m_filename(std::move(filename)), m_stamp(stamp()),
+      m_snapshot(read()) {
+  if (!m_snapshot) {
+    // Empty until file can be read (stamp reset, so reload() tries again)
+    m_snapshot = std::make_shared<const InputBlock>(m_name);
+    m_stamp = Stamp{};
+  }
+}
+
+std::shared_ptr<const InputBlock> InputWatcher::read() const {
+  const auto text = read_file(m_filename);
+  if (!text)
+    return nullptr;
+  return std::make_shared<const InputBlock>(m_name, *text);
+}
+
+InputWatcher::Stamp InputWatcher::stamp() const {
+  std::error_code ec;
+  Stamp stamp;
+  stamp.exists = std::filesystem::is_regular_file(m_filename, ec);
+  if (stamp.exists) {
+    stamp.time = std::filesystem::last_write_time(m_filename, ec);
+    stamp.size = std::filesystem::file_size(m_filename, ec);
+  }
+  return stamp;
+}
+
+std::size_t InputWatcher::subscribe(Callback callback,
+                                    std::vector<std::string> block_path) {
+  const std::lock_guard<std::mutex> lock(m_subscriber_mutex);
+  m_subscribers.push_back(
+      {m_next_id, std::move(block_path), std::move(callback)});
+  return m_next_id++;
+}
+
+void InputWatcher::unsubscribe(std::size_t id) {
+  const std::lock_guard<std::mutex> lock(m_subscriber_mutex);
+  m_subscribers.erase(std::remove_if(m_subscribers.begin(),
+                                     m_subscribers.end(),
+                                     [id](const auto &s) { return s.id == id; }),
+                      m_subscribers.end());
+}
+
+bool InputWatcher::reload() {
+  const std::lock_guard<std::mutex> reload_lock(m_reload_mutex);
+  const auto before = stamp();
+  if (before == m_stamp)
+    return false;
+  if (!before.exists) {
+    // e.g., being replaced: keep current input until new file appears
+    m_stamp = before;
+    return false;
+  }
+  // If it cannot be read (e.g., permissions), nothing changes: tried again
+  // next time
+  const auto next = read();
+  if (!next || !(stamp() == before))
+    return false; // (or modified while being read: read again next time)
+  m_stamp = before;
+
+  const auto previous = snapshot();
+  // nb: compares hashes first, so unchanged blocks are skipped quickly
+  const auto changes = previous->diff(*next);
+  if (changes.empty())
+    return false; // e.g., only comments or formatting changed
+  {
+    const std::lock_guard<std::mutex> lock(m_snapshot_mutex);
+    m_snapshot = next;
+  }
+
+  std::vector<Subscriber> subscribers;
+  {
+    const std::lock_guard<std::mutex> lock(m_subscriber_mutex);
+    subscribers = m_subscribers;
+  }
+  for (const auto &subscriber : subscribers) {
+    const auto &prefix = subscriber.block_path;
+    if (prefix.empty()) {
+      subscriber.callback(next, changes);
+      continue;
+    }
+    // Changes inside block_path, incl. the block itself being added/removed
+    Changes relevant;
+    for (const auto &change : changes) {
+      auto path = change.path;
+      if (change.is_block)
+        path.push_back(change.name);
+      if (path.size() >= prefix.size() &&
+          std::equal(prefix.begin(), prefix.end(), path.begin()))
+        relevant.push_back(change);
+    }
+    if (!relevant.empty())
+      subscriber.callback(next, relevant);
+  }
+  return true;
+}
+
+void InputWatcher::watch(std::chrono::milliseconds poll_interval) {
+  stop();
+  m_stopping = false;
+#if defined(USERIO_HAVE_INOTIFY)
+  if (::pipe(m_wake_pipe) != 0)
+    m_wake_pipe[0] = m_wake_pipe[1] = -1;
+#endif
+  m_thread = std::thread([this, poll_interval] { run(poll_interval); });
+}
+
+void InputWatcher::stop() {
+  if (!m_thread.joinable())
+    return;
+  {
+    const std::lock_guard<std::mutex> lock(m_stop_mutex);
+    m_stopping = true;
+  }
+  m_stop_cv.notify_all();
+#if defined(USERIO_HAVE_INOTIFY)
+  if (m_wake_pipe[1] >= 0) {
+    const char c = 0;
+    [[maybe_unused]] const auto n = ::write(m_wake_pipe[1], &c, 1);
+  }
+#endif
+  m_thread.join();
+#if defined(USERIO_HAVE_INOTIFY)
+  for (auto &fd : m_wake_pipe) {
+    if (fd >= 0)
+      ::close(fd);
+    fd = -1;
+  }
+#endif
+}
+
+void InputWatcher::run(std::chrono::milliseconds poll_interval) {
+  // When polling, a file is only re-read once it has been unchanged for one
+  // interval (so one that is still being written is not read)
+  auto seen = stamp();
+  const auto check = [&] {
+    const auto now = stamp();
+    if (now == seen)
+      reload();
+    seen = now;
+  };
+#if defined(USERIO_HAVE_INOTIFY)
+  // Watches the directory, since editors often replace the file (rename)
+  const int fd = ::inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  const auto path = std::filesystem::path(m_filename);
+  auto directory = path.parent_path();
+  if (directory.empty())
+    directory = ".";
+  if (fd >= 0 && m_wake_pipe[0] >= 0 &&
+      ::inotify_add_watch(fd, directory.c_str(),
+                          IN_CLOSE_WRITE | IN_MOVED_TO | IN_ATTRIB) >= 0) {
+    const auto name = path.filename().string();
+    pollfd fds[2] = {{fd, POLLIN, 0}, {m_wake_pipe[0], POLLIN, 0}};
+    alignas(inotify_event) char buffer[4096];
+    while (true) {
+      if (::poll(fds, 2, int(poll_interval.count())) == 0) {
+        check(); // in case an event was missed
+        continue;
+      }
+      if (fds[1].revents != 0)
+        break; // stop()
+      // Finished writing (or replacing) this file: re-read straight away
+      bool modified = false;
+      for (auto n = ::read(fd, buffer, sizeof(buffer)); n > 0;
+           n = ::read(fd, buffer, sizeof(buffer))) {
+        for (auto p = buffer; p < buffer + n;) {
+          const auto event = reinterpret_cast<const inotify_event *>(p);
+          if (event->len > 0 && name == event->name)
+            modified = true;
+          p += sizeof(inotify_event) + event->len;
+        }
+      }
+      if (modified) {
+        reload();
+        seen = stamp();
+      }
+    }
+    ::close(fd);
+    return;
+  }
+  if (fd >= 0)
+    ::close(fd);
+#endif
+  std::unique_lock<std::mutex> lock(m_stop_mutex);
+  while (!m_stop_cv.wait_for(lock, poll_interval,
+                             [this] { return m_stopping; })) {
+    lock.unlock();
+    check();
+    lock.lock();
+  }
 }
 
 } // namespace UserIO
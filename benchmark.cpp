@@ -0,0 +1,316 @@
+#include "InputBlock.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <new>
+#include <sstream>
+#include <string>
+#include <vector>
+
+/*
+Benchmarks for UserIO::InputBlock. Build with optimisations, e.g.:
+  g++ -std=c++17 -O3 benchmark.cpp -o benchmark -pthread
+Usage:
+  ./benchmark [--json] [--scale x]
+Each operation is timed separately, on a set of generated inputs (many options,
+many sibling blocks, deep nesting, long lists, many comments). Reports time per
+operation, throughput (MB/s, or operations/s), and heap allocations per
+operation. --json writes the same results as JSON (for tracking regressions).
+--scale multiplies the size of each input (default 1).
+*/
+
+//******************************************************************************
+// Counts every heap allocation
+namespace {
+std::atomic<std::size_t> g_allocations{0};
+const void *volatile g_sink = nullptr;
+} // namespace
+
+#if defined(__GNUC__) && !defined(__clang__)
+// nb: operator new below uses malloc, so free is correct
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+void *operator new(std::size_t size) {
+  ++g_allocations;
+  if (void *p = std::malloc(size == 0 ? 1 : size))
+    return p;
+  throw std::bad_alloc{};
+}
+void operator delete(void *p) noexcept { std::free(p); }
+void operator delete(void *p, std::size_t) noexcept { std::free(p); }
+// nb: std::pmr::new_delete_resource (used by InputTree) uses aligned new
+void *operator new(std::size_t size, std::align_val_t align) {
+  ++g_allocations;
+  const auto a = std::max(std::size_t(align), sizeof(void *));
+  if (void *p = std::aligned_alloc(a, (size + a - 1) / a * a))
+    return p;
+  throw std::bad_alloc{};
+}
+void operator delete(void *p, std::align_val_t) noexcept { std::free(p); }
+void operator delete(void *p, std::size_t, std::align_val_t) noexcept {
+  std::free(p);
+}
+
+//******************************************************************************
+// Synthetic input
+struct Shape {
+  std::string name;
+  int options = 0;     // options per block
+  int blocks = 0;      // sibling blocks (each with 'options' options)
+  int depth = 0;       // extra levels of nesting, inside each block
+  int list_length = 0; // elements in a list option (in each block)
+  int comments = 0;    // comment lines per option
+  int repeats = 1;     // each block name appears this many times
+};
+
+std::string generate(const Shape &shape) {
+  std::string out;
+  const auto options = [&](const std::string &indent, int block) {
+    for (int i = 0; i < shape.options; ++i) {
+      for (int c = 0; c < shape.comments; ++c) {
+        out += indent + (c % 2 == 0 ? "// comment about key " : "/* comment */ ");
+        out += std::to_string(i) + "\n";
+      }
+      out += indent + "key" + std::to_string(i) + " = " +
+             std::to_string(block * 1000 + i) + ".5;\n";
+    }
+    if (shape.list_length > 0) {
+      out += indent + "list = ";
+      for (int i = 0; i < shape.list_length; ++i)
+        out += (i == 0 ? "" : ",") + std::to_string(i * 0.25);
+      out += ";\n";
+    }
+  };
+  options("", -1);
+  const auto unique_blocks = std::max(shape.blocks / shape.repeats, 1);
+  for (int b = 0; b < shape.blocks; ++b) {
+    out += "Block" + std::to_string(b % unique_blocks) + " {\n";
+    std::string indent = "  ";
+    options(indent, b);
+    for (int d = 0; d < shape.depth; ++d) {
+      out += indent + "Level" + std::to_string(d) + " {\n";
+      indent += "  ";
+      options(indent, b);
+    }
+    for (int d = shape.depth; d >= 0; --d) {
+      indent.resize(indent.size() - 2);
+      out += indent + "}\n";
+    }
+  }
+  return out;
+}
+
+//******************************************************************************
+// Timing
+struct Result {
+  std::string input, operation;
+  double seconds_per_op;
+  double allocations_per_op;
+  double bytes_per_op; // 0 if not a throughput measurement
+};
+
+// Runs f repeatedly (at least once, and for at least min_seconds). Each call
+// of f performs ops_per_call operations (on bytes_per_call bytes in total)
+template <typename F>
+Result measure(const std::string &input, const std::string &operation,
+               double bytes_per_call, std::size_t ops_per_call, F f,
+               double min_seconds = 0.25) {
+  using clock = std::chrono::steady_clock;
+  std::size_t reps = 0;
+  const auto allocations0 = g_allocations.load();
+  const auto t0 = clock::now();
+  double elapsed = 0.0;
+  do {
+    f();
+    ++reps;
+    elapsed = std::chrono::duration<double>(clock::now() - t0).count();
+  } while (elapsed < min_seconds);
+  const auto allocations = g_allocations.load() - allocations0;
+  const auto ops = double(reps * ops_per_call);
+  return {input, operation, elapsed / ops, double(allocations) / ops,
+          bytes_per_call / double(ops_per_call)};
+}
+
+// Prevents the compiler optimising away unused results
+template <typename T> void keep(const T &value) { g_sink = &value; }
+
+//******************************************************************************
+void benchmark(const Shape &shape, std::vector<Result> &results) {
+  using namespace UserIO;
+  const auto text = generate(shape);
+  const auto size = double(text.size());
+  const auto &name = shape.name;
+
+  results.push_back(measure(name, "parse", size, 1, [&] {
+    const InputBlock ib("ib", text);
+    keep(ib);
+  }));
+  results.push_back(measure(name, "parse_tree", size, 1, [&] {
+    const InputTree tree("ib", text);
+    keep(tree);
+  }));
+  if (text.size() > (1 << 20)) {
+    results.push_back(measure(name, "parse_parallel", size, 1, [&] {
+      InputBlock ib("ib");
+      ib.addParallel(text);
+      keep(ib);
+    }));
+  }
+  results.push_back(measure(name, "parse_merge", size, 1, [&] {
+    InputBlock ib("ib");
+    ib.add(text, true);
+    keep(ib);
+  }));
+
+  const InputBlock ib("ib", text);
+  // Keys/blocks looked up in a fixed pseudo-random order
+  const std::size_t num_keys = 1000;
+  std::vector<std::string> keys, blocks;
+  const auto unique_blocks = std::max(shape.blocks / shape.repeats, 1);
+  for (std::size_t i = 0; i < num_keys; ++i) {
+    const auto r = int((i * 7919) % 10007);
+    keys.push_back("key" + std::to_string(r % std::max(shape.options, 1)));
+    blocks.push_back("Block" + std::to_string(r % unique_blocks));
+  }
+
+  if (shape.options > 0) {
+    results.push_back(measure(name, "get", 0.0, num_keys, [&] {
+      double sum = 0.0;
+      for (const auto &key : keys)
+        sum += ib.get(key, 0.0);
+      keep(sum);
+    }));
+  }
+  if (shape.blocks > 0) {
+    results.push_back(measure(name, "get_nested", 0.0, num_keys, [&] {
+      double sum = 0.0;
+      for (std::size_t i = 0; i < num_keys; ++i) {
+        sum += shape.depth > 0
+                   ? ib.get({blocks[i], "Level0"}, keys[i], 0.0)
+                   : ib.get({blocks[i]}, keys[i], 0.0);
+      }
+      keep(sum);
+    }));
+  }
+  if (shape.list_length > 0) {
+    const auto list_bytes = double(ib.findOption("list")->value_str.size());
+    results.push_back(measure(name, "get_vector", list_bytes, 1, [&] {
+      const auto list = ib.get<std::vector<double>>("list");
+      keep(list);
+    }));
+    std::vector<double> buffer;
+    results.push_back(measure(name, "getList", list_bytes, 1, [&] {
+      ib.getList("list", buffer);
+      keep(buffer);
+    }));
+  }
+
+  std::vector<std::pair<std::string, std::string>> allowed;
+  for (int i = 0; i < shape.options; ++i)
+    allowed.emplace_back("key" + std::to_string(i), "description");
+  for (int b = 0; b < unique_blocks; ++b)
+    allowed.emplace_back("Block" + std::to_string(b), "description");
+  allowed.emplace_back("list", "description");
+  results.push_back(measure(name, "checkBlock", 0.0, 1, [&] {
+    const auto ok = ib.checkBlock(allowed);
+    keep(ok);
+  }));
+
+  std::ostringstream printed;
+  ib.print(printed);
+  const auto print_size = double(printed.str().size());
+  results.push_back(measure(name, "print", print_size, 1, [&] {
+    std::ostringstream os;
+    ib.print(os);
+    keep(os);
+  }));
+  std::string buffer;
+  results.push_back(measure(name, "serialize", print_size, 1, [&] {
+    buffer.clear();
+    ib.serialize(buffer);
+    keep(buffer);
+  }));
+  const auto minified_size =
+      double(ib.serialize(InputBlock::Layout::Minified).size());
+  results.push_back(measure(name, "serialize_min", minified_size, 1, [&] {
+    buffer.clear();
+    ib.serialize(buffer, InputBlock::Layout::Minified);
+    keep(buffer);
+  }));
+}
+
+//******************************************************************************
+void print_table(const std::vector<Result> &results) {
+  std::printf("%-10s %-15s %12s %14s %12s\n", "input", "operation",
+              "time/op", "throughput", "allocs/op");
+  for (const auto &r : results) {
+    char throughput[32];
+    if (r.bytes_per_op > 0.0)
+      std::snprintf(throughput, sizeof(throughput), "%.1f MB/s",
+                    r.bytes_per_op / r.seconds_per_op / 1.0e6);
+    else
+      std::snprintf(throughput, sizeof(throughput), "%.3g op/s",
+                    1.0 / r.seconds_per_op);
+    std::printf("%-10s %-15s %9.3f us %14s %12.1f\n", r.input.c_str(),
+                r.operation.c_str(), r.seconds_per_op * 1.0e6, throughput,
+                r.allocations_per_op);
+  }
+}
+
+void print_json(const std::vector<Result> &results) {
+  std::printf("[\n");
+  for (std::size_t i = 0; i < results.size(); ++i) {
+    const auto &r = results[i];
+    std::printf("  {\"input\": \"%s\", \"operation\": \"%s\", "
+                "\"seconds_per_op\": %.6e, \"ops_per_second\": %.6e, "
+                "\"mb_per_second\": %.6e, \"allocations_per_op\": %.1f}%s\n",
+                r.input.c_str(), r.operation.c_str(), r.seconds_per_op,
+                1.0 / r.seconds_per_op,
+                r.bytes_per_op / r.seconds_per_op / 1.0e6,
+                r.allocations_per_op, i + 1 < results.size() ? "," : "");
+  }
+  std::printf("]\n");
+}
+
+//******************************************************************************
+int main(int argc, char *argv[]) {
+  bool json = false;
+  double scale = 1.0;
+  for (int i = 1; i < argc; ++i) {
+    const std::string arg = argv[i];
+    if (arg == "--json") {
+      json = true;
+    } else if (arg == "--scale" && i + 1 < argc) {
+      scale = std::atof(argv[++i]);
+    } else {
+      std::cerr << "Usage: " << argv[0] << " [--json] [--scale x]\n";
+      return 1;
+    }
+  }
+  const auto n = [scale](int x) { return std::max(int(x * scale), 1); };
+
+  const std::vector<Shape> shapes{
+      {"wide", n(20000), 0, 0, 0, 0, 1},
+      {"siblings", 10, n(20000), 0, 0, 0, 1},
+      {"deep", 5, n(200), 50, 0, 0, 1},
+      {"lists", 2, n(50), 0, 10000, 0, 1},
+      {"comments", 10, n(2000), 0, 0, 4, 1},
+      {"repeated", 10, n(20000), 1, 0, 0, 10},
+  };
+
+  // checkBlock reports to cout; results printed once all are done
+  std::vector<Result> results;
+  std::ostringstream discard;
+  const auto cout_buf = std::cout.rdbuf(discard.rdbuf());
+  for (const auto &shape : shapes)
+    benchmark(shape, results);
+  std::cout.rdbuf(cout_buf);
+
+  if (json)
+    print_json(results);
+  else
+    print_table(results);
+}
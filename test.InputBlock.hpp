@@ -1,9 +1,33 @@
 #pragma once
 #include "InputBlock.hpp"
 #include <cassert>
+#include <cstdio>
+#include <fstream>
 #include <iostream>
 
 inline void run_tests(const UserIO::InputBlock &ib);
+inline void test_parser();
+inline void test_files();
+inline void test_lookup();
+inline void test_tree();
+inline void test_conversion();
+inline void test_lists();
+inline void test_cache();
+inline void test_keys();
+inline void test_snapshot();
+inline void test_parallel();
+inline void test_scanner();
+inline void test_events();
+inline void test_lazy();
+inline void test_merge();
+inline void test_schema();
+inline void test_binding();
+inline void test_allocators();
+inline void test_telemetry();
+inline void test_tracing();
+inline void test_serialize();
+inline void test_hash_diff();
+inline void test_watcher();
 
 inline void test_InputBlock() {
   // A basic unit test  of UserIO::InputBlock
@@ -48,6 +72,29 @@ inline void test_InputBlock() {
   ib2.print(ostr2);
   assert(ostr1.str() == ostr2.str());
 
+  test_parser();
+  test_files();
+  test_lookup();
+  test_tree();
+  test_conversion();
+  test_lists();
+  test_cache();
+  test_keys();
+  test_snapshot();
+  test_parallel();
+  test_scanner();
+  test_events();
+  test_lazy();
+  test_merge();
+  test_schema();
+  test_binding();
+  test_allocators();
+  test_telemetry();
+  test_tracing();
+  test_serialize();
+  test_hash_diff();
+  test_watcher();
+
   std::cout << "\nPassed all tests :)\n";
 }
 
@@ -98,3 +145,1469 @@ void run_tests(const UserIO::InputBlock &ib) {
   // Test the 'blank' option - should return default (2)
   assert(ib.get("blank", 2) == 2);
 }
+
+//******************************************************************************
+void test_parser() {
+  using namespace UserIO;
+
+  // Comments, white space and quotes are stripped while parsing
+  const std::string input = "a = 1; // a=2;\n"
+                            "b = 'x y' ; # c=3;\n"
+                            "c = \"4\"; ! c=5;\n"
+                            "/* d=6;\n d=7; */ d = 8/2;\n"
+                            "Blk /* comment */ { e = 9; /* } */ f = 10; }\n"
+                            "trailing = 11";
+  const InputBlock ib("ib", input);
+  assert(ib.options().size() == 4);
+  assert(ib.get<int>("a") == 1);
+  assert(ib.get("b") == "xy");
+  assert(ib.get<int>("c") == 4);
+  assert(ib.get("d") == "8/2");
+  assert(ib.get<int>({"Blk"}, "e") == 9);
+  assert(ib.get<int>({"Blk"}, "f") == 10);
+  // options not terminated by ';' are ignored
+  assert(!ib.get("trailing"));
+
+  // Same result when input is lexed in small pieces
+  struct Counter {
+    int options = 0, blocks = 0;
+    void on_option(std::string_view, std::string_view) { ++options; }
+    void on_block_begin(std::string_view) { ++blocks; }
+    void on_block_end() {}
+  } counter;
+  Lexer lexer(counter);
+  for (std::size_t i = 0; i < input.size(); i += 3)
+    lexer.feed(std::string_view(input).substr(i, 3));
+  lexer.finish();
+  assert(counter.options == 6 && counter.blocks == 1);
+
+  // Arbitrarily deep nesting
+  const int depth = 5000;
+  std::string deep;
+  for (int i = 0; i < depth; ++i)
+    deep += "B" + std::to_string(i) + "{";
+  deep += "x=1;";
+  deep += std::string(depth, '}');
+  const InputBlock ib_deep("deep", deep);
+  const InputBlock *pB = &ib_deep;
+  for (int i = 0; i < depth; ++i) {
+    assert(pB->blocks().size() == 1);
+    pB = &pB->blocks().front();
+  }
+  assert(pB->get<int>("x") == 1);
+
+  // Unbalanced braces are reported (to cerr) with their location
+  std::stringstream err;
+  auto cerr_buf = std::cerr.rdbuf(err.rdbuf());
+  const InputBlock ib_unbalanced("ub", "A{a=1;}}\nb=2;\nC{ D{ c=3;");
+  std::cerr.rdbuf(cerr_buf);
+  assert(err.str().find("unmatched '}' at 1:8") != std::string::npos);
+  assert(err.str().find("2 unclosed '{'") != std::string::npos);
+  assert(err.str().find("opened at 3:5") != std::string::npos);
+  assert(ib_unbalanced.get<int>({"A"}, "a") == 1);
+  assert(ib_unbalanced.get<int>("b") == 2);
+  assert(ib_unbalanced.get<int>({"C", "D"}, "c") == 3);
+
+  // Stand-alone comment/space removal
+  assert(removeSpaces(removeComments(input)) ==
+         "a=1;b=xy;c=4;d=8/2;Blk{e=9;f=10;}trailing=11");
+}
+
+//******************************************************************************
+void test_files() {
+  using namespace UserIO;
+
+  const std::string input = "a = 1; // comment\nBlk{ b = 2; }\nlist=1,2,3;\n";
+  const std::string filename = "test.InputBlock.tmp";
+  std::ofstream(filename) << input;
+
+  std::stringstream expected, from_file, from_stream;
+  InputBlock("ib", input).print(expected);
+  // Memory-mapped file
+  InputBlock::fromFile("ib", filename).print(from_file);
+  assert(from_file.str() == expected.str());
+  // Read from stream, in chunks
+  InputBlock("ib", std::ifstream(filename)).print(from_stream);
+  assert(from_stream.str() == expected.str());
+  assert(file_to_string(std::ifstream(filename)) == input);
+  assert(read_file(filename) == input);
+  std::remove(filename.c_str());
+
+#if defined(USERIO_HAVE_MMAP)
+  // Not a regular file (size unknown): read in full, not treated as empty
+  const std::string fifo = "test.InputBlock.fifo";
+  std::remove(fifo.c_str());
+  [[maybe_unused]] const auto made_fifo =
+      ::mkfifo(fifo.c_str(), 0600) == 0;
+  assert(made_fifo);
+  std::thread writer([&] { std::ofstream(fifo) << input; });
+  std::stringstream from_fifo;
+  InputBlock::fromFile("ib", fifo).print(from_fifo);
+  writer.join();
+  assert(from_fifo.str() == expected.str());
+  std::remove(fifo.c_str());
+#endif
+
+  // Missing file: empty block
+  assert(!MappedFile("does_not_exist.in"));
+  const auto missing = InputBlock::fromFile("ib", "does_not_exist.in");
+  assert(missing.options().empty() && missing.blocks().empty());
+}
+
+//******************************************************************************
+void test_lookup() {
+  using namespace UserIO;
+
+  // Enough options/blocks that lookups go via the hash index
+  std::string input;
+  for (int i = 0; i < 100; ++i)
+    input += "k" + std::to_string(i) + "=" + std::to_string(i) + ";B" +
+             std::to_string(i) + "{x=" + std::to_string(i) + ";}";
+  input += "k7=-7; B7{x=-7;}";
+  InputBlock ib("ib", input);
+  assert(ib.get<int>("k0") == 0);
+  assert(ib.get<int>("k99") == 99);
+  assert(!ib.get<int>("k100"));
+  assert(!ib.getBlock("B100"));
+  // Later options/blocks override earlier ones
+  assert(ib.get<int>("k7") == -7);
+  assert(ib.get<int>({"B7"}, "x") == -7);
+
+  // Index stays current after add()
+  ib.add(Option{"k8", "-8"});
+  ib.add(Option{"k100", "100"});
+  ib.add(InputBlock("B8", {{"x", "-8"}}));
+  ib.add(InputBlock("B9", {{"y", "9"}}), true);
+  ib.add("k9=-9; B100{x=100;}");
+  assert(ib.get<int>("k8") == -8);
+  assert(ib.get<int>("k9") == -9);
+  assert(ib.get<int>("k100") == 100);
+  assert(ib.getOption("k100")->value_str == "100");
+  assert(ib.get<int>({"B8"}, "x") == -8);
+  assert(ib.get<int>({"B9"}, "y") == 9);
+  assert(ib.get<int>({"B100"}, "x") == 100);
+
+  // Zero-copy lookups
+  assert(ib.findBlock("B8") == &ib.blocks().back() - 1);
+  assert(ib.findBlock({"B8"}) == ib.findBlock("B8"));
+  assert(ib.findBlock({}) == &ib);
+  assert(ib.findBlock("B101") == nullptr);
+  assert(ib.findBlock({"B8", "x"}) == nullptr);
+  assert(ib.findOption("k9")->value_str == "-9");
+  assert(ib.findOption("k101") == nullptr);
+  const InputBlock nested("n", "A{B{C{x=1;}}}");
+  assert(nested.findBlock({"A", "B", "C"})->get<int>("x") == 1);
+  assert(nested.findBlock({"A", "B", "C"}) ==
+         &nested.blocks()[0].blocks()[0].blocks()[0]);
+  assert(nested.blocks()[0] == "A" && "A" == nested.blocks()[0]);
+  assert(nested.blocks()[0] != "B" && "B" != nested.blocks()[0]);
+
+  // ..and when copied, or consolidated
+  const auto ib2 = ib;
+  assert(ib2.get<int>("k9") == -9);
+  assert(ib2.get<int>({"B100"}, "x") == 100);
+  ib.add("B3{y=3;}", true);
+  assert(ib.blocks().size() == 101);
+  assert(ib.get<int>({"B3"}, "x") == 3 && ib.get<int>({"B3"}, "y") == 3);
+  assert(ib.get<int>({"B99"}, "x") == 99);
+
+  // Positions are 32-bit: larger ones are an error, not silently truncated
+  KeyIndex index;
+  const auto key_of = [](std::size_t) { return std::string_view("k"); };
+  [[maybe_unused]] bool threw = false;
+  try {
+    index.insert(std::size_t(std::uint32_t(-1)), key_of);
+  } catch (const std::length_error &) {
+    threw = true;
+  }
+  assert(threw && index.empty());
+}
+
+//******************************************************************************
+void test_tree() {
+  using namespace UserIO;
+
+  const std::string input = "k1 = 1; k2 = 2.5; k3=number_3;\n"
+                            "blockA{ kA1 = old_val; kA1 = new_val; }\n"
+                            "blockC{ kC1=1; InnerBlock{ kib1=-6; } kC2=2; }\n"
+                            "blockA{ kA2 = 2; }\n"
+                            "list = 1,2,3,4,5; bool1 = true; blank;";
+  const InputTree tree("tree", input);
+  const auto root = tree.root();
+  assert(root.name() == "tree");
+  assert(root.num_options() == 6 && root.num_blocks() == 3);
+  assert(root.get("k1", 0) == 1);
+  assert(root.get<double>("k2") == 2.5);
+  assert(root.get("k3") == "number_3");
+  assert(!root.get("k109"));
+  assert(root.get("blank", 2) == 2);
+  assert(root.get<bool>("bool1") == true);
+  assert(root.get<std::vector<int>>("list") ==
+         std::vector<int>({1, 2, 3, 4, 5}));
+  // Later blocks/options override earlier ones
+  assert(root.get({"blockA"}, "kA2", 0) == 2);
+  assert(root.block(0).get("kA1") == "new_val");
+  assert(root.get<int>({"blockC", "InnerBlock"}, "kib1") == -6);
+  assert(root.getBlock("blockC")->get<int>("kC2") == 2);
+  assert(root.getBlock({"blockC", "InnerBlock"})->num_options() == 1);
+  assert(!root.getBlock("blockZ"));
+  assert(root.option(2).key == "k3" && root.option(2).value_str == "number_3");
+
+  // Identical to InputBlock
+  std::stringstream expected, actual;
+  InputBlock("tree", input).print(expected);
+  tree.toInputBlock().print(actual);
+  assert(expected.str() == actual.str());
+
+  // Text stored once, compactly
+  assert(tree.memory() < 2 * input.size() + 7 * 16 + 4 * 24 + 64);
+
+  const InputTree empty;
+  assert(empty.root().num_options() == 0 && empty.root().num_blocks() == 0);
+}
+
+//******************************************************************************
+void test_conversion() {
+  using namespace UserIO;
+
+  // Lenient conversion: as stringstream, uses leading valid part of string
+  assert(parse_str_to_T<int>("42") == 42);
+  assert(parse_str_to_T<int>("+42") == 42);
+  assert(parse_str_to_T<int>("-42") == -42);
+  assert(parse_str_to_T<int>("2.5") == 2);
+  assert(parse_str_to_T<double>("1.5abc") == 1.5);
+  assert(parse_str_to_T<double>("-2.5e-3") == -2.5e-3);
+  assert(parse_str_to_T<float>(".5") == 0.5f);
+  assert(parse_str_to_T<unsigned long>("18446744073709551615") ==
+         18446744073709551615ul);
+  assert(parse_str_to_T<char>("xyz") == 'x');
+  assert(parse_str_to_T<std::string>("a b") == "a b");
+  assert(parse_str_to_T<bool>("yes") && !parse_str_to_T<bool>("maybe"));
+  // Not a number at all: value-initialised (not junk)
+  assert(parse_str_to_T<int>("abc") == 0);
+  assert(parse_str_to_T<double>("") == 0.0);
+
+  // Strict conversion
+  assert(try_parse_str_to_T<int>("42") == 42);
+  assert(try_parse_str_to_T<double>("-2.5e-3") == -2.5e-3);
+  assert(!try_parse_str_to_T<int>("2.5"));
+  assert(!try_parse_str_to_T<double>("1.5abc"));
+  assert(!try_parse_str_to_T<double>(""));
+  assert(!try_parse_str_to_T<int>("99999999999999999999"));
+  assert(try_parse_str_to_T<bool>("No") == false);
+  assert(!try_parse_str_to_T<bool>("maybe"));
+  assert(try_parse_str_to_T<char>("x") == 'x' && !try_parse_str_to_T<char>("xy"));
+
+  // Strict mode for get
+  const InputBlock ib("ib", "x=1.5abc; y=2.5; z=default; list=1,2,x;");
+  assert(ib.get<double>("x") == 1.5);
+  std::stringstream out;
+  auto cout_buf = std::cout.rdbuf(out.rdbuf());
+  assert(!ib.getStrict<double>("x"));
+  assert(ib.getStrict("x", 3.0) == 3.0);
+  assert(!ib.getStrict<std::vector<int>>("list"));
+  std::cout.rdbuf(cout_buf);
+  assert(out.str().find("x = 1.5abc") != std::string::npos);
+  assert(out.str().find("list = 1,2,x") != std::string::npos);
+  assert(ib.getStrict<double>("y") == 2.5);
+  assert(!ib.getStrict<double>("z") && !ib.getStrict<double>("w"));
+}
+
+//******************************************************************************
+namespace test_structs {
+// List element whose parsing throws (for element "throw")
+struct Throws {
+  long value = 0;
+  friend std::istream &operator>>(std::istream &is, Throws &t) {
+    std::string str;
+    is >> str;
+    if (str == "throw")
+      throw std::runtime_error("bad element");
+    t.value = std::stol(str);
+    return is;
+  }
+};
+} // namespace test_structs
+
+void test_lists() {
+  using namespace UserIO;
+
+  const InputBlock ib("ib", "a=1,2,3; b=1.5,-2,x; c=; d=1,2,; e=yes,no,1;");
+  assert(list_size("1,2,3") == 3 && list_size("") == 0 && list_size("1,") == 2);
+
+  std::vector<int> list{9, 9, 9, 9, 9};
+  assert(ib.getList("a", list) && list == std::vector<int>({1, 2, 3}));
+  assert(!ib.getList("c", list) && !ib.getList("z", list));
+  assert(list.size() == 3);
+  assert(ib.getList("d", list) && list == std::vector<int>({1, 2, 0}));
+  std::vector<bool> bools;
+  assert(ib.getList("e", bools) && bools == std::vector<bool>({1, 0, 1}));
+
+  double buffer[2]{};
+  assert(ib.getList("b", buffer, 2) == 3);
+  assert(buffer[0] == 1.5 && buffer[1] == -2.0);
+  assert(ib.getList("b", buffer, 0) == 3);
+  assert(ib.getList("z", buffer, 2) == 0);
+
+  std::vector<double> dlist;
+  assert(!parse_list("1.5,-2,x", dlist, true));
+  assert(parse_list("1.5,-2,3", dlist, true));
+
+  // Very long list: parsed in parallel
+  const std::size_t size = 300000;
+  std::string long_list;
+  for (std::size_t i = 0; i < size; ++i)
+    long_list += std::to_string(i) + ",";
+  long_list += "-1";
+  assert(long_list.size() > parallel_list_threshold);
+  const InputBlock ib_long("long", "list=" + long_list + ";");
+  std::vector<long> longs;
+  assert(ib_long.getList("list", longs) && longs.size() == size + 1);
+  for (std::size_t i = 0; i < size; ++i)
+    assert(longs[i] == long(i));
+  assert(longs.back() == -1);
+  assert(ib_long.get<std::vector<long>>("list") == longs);
+  assert(parse_list(long_list, longs, true));
+  assert(!parse_list(long_list + ",x", longs, true));
+
+  // Exceptions from any chunk reach the caller (after all chunks finish)
+  std::vector<test_structs::Throws> throws;
+  [[maybe_unused]] bool threw = false;
+  try {
+    parse_list("throw," + long_list, throws);
+  } catch (const std::runtime_error &) {
+    threw = true;
+  }
+  assert(threw);
+  parse_list(long_list, throws);
+  assert(throws.size() == size + 1 && throws[size / 2].value == long(size / 2));
+
+  // Concurrent readers share one set of worker threads
+  const auto expected_longs = ib_long.get<std::vector<long>>("list");
+  std::vector<std::thread> readers;
+  std::atomic<int> correct{0};
+  for (int i = 0; i < 8; ++i) {
+    readers.emplace_back([&] {
+      if (ib_long.get<std::vector<long>>("list") == expected_longs)
+        ++correct;
+    });
+  }
+  for (auto &reader : readers)
+    reader.join();
+  assert(correct == 8);
+
+  // The pool itself (nb: shared() has no workers on a single core)
+  detail::ThreadPool pool(3);
+  std::vector<int> squares(100);
+  pool.run(squares.size(), 4, [&](std::size_t i) {
+    // nested runs (from a worker) are done by that worker if pool is busy
+    pool.run(1, 4, [&](std::size_t) { squares[i] = int(i * i); });
+  });
+  for (std::size_t i = 0; i < squares.size(); ++i)
+    assert(squares[i] == int(i * i));
+  std::atomic<int> ran{0};
+  std::string error;
+  try {
+    pool.run(100, 4, [&](std::size_t i) {
+      ++ran;
+      if (i == 5 || i == 50)
+        throw std::runtime_error(std::to_string(i));
+    });
+  } catch (const std::runtime_error &e) {
+    error = e.what();
+  }
+  assert(ran == 100 && error == "5"); // all run; first error rethrown
+}
+
+//******************************************************************************
+void test_cache() {
+  using namespace UserIO;
+
+  ValueCache cache;
+  assert(!cache.load<double>());
+  cache.store(2.5);
+  assert(cache.load<double>() == 2.5);
+  // Only one type held at a time: first is kept
+  cache.store(3);
+  assert(!cache.load<int>() && cache.load<double>() == 2.5);
+  const auto copy = cache;
+  assert(copy.load<double>() == 2.5);
+  static_assert(ValueCache::cacheable<double> && ValueCache::cacheable<bool>);
+  static_assert(!ValueCache::cacheable<std::string>);
+
+  // Repeated get<T> gives same value, whichever type is cached
+  InputBlock ib("ib", "x=2.5; b=yes;");
+  for (int i = 0; i < 3; ++i) {
+    assert(ib.get<double>("x") == 2.5);
+    assert(ib.get<int>("x") == 2);
+    assert(ib.get<bool>("b") == true);
+    assert(ib.get("x") == "2.5");
+  }
+  // Later options override earlier, even once cached
+  ib.add(Option{"x", "-1"});
+  assert(ib.get<double>("x") == -1.0);
+  const auto ib2 = ib;
+  assert(ib2.get<double>("x") == -1.0);
+  ib.add("x=4;", true);
+  assert(ib.get<double>("x") == 4.0 && ib2.get<double>("x") == -1.0);
+}
+
+//******************************************************************************
+void test_keys() {
+  using namespace UserIO;
+
+  InputBlock ib("ib", "g=-9.8; Dog{ mass=1.0; Puppy{ mass=0.1; } }");
+  const auto g = ib.makeKey<double>("g");
+  const auto mass = ib.makeKey<double>({"Dog", "Puppy"}, "mass");
+  const auto speed = ib.makeKey<double>({"Dog"}, "speed");
+  const auto cat = ib.makeKey<double>({"Cat"}, "mass");
+  for (int i = 0; i < 3; ++i) {
+    assert(g.get() == -9.8);
+    assert(mass.get(0.0) == 0.1);
+    assert(!speed.get() && speed.get(5.0) == 5.0);
+    assert(!cat.get());
+  }
+
+  // Handles are re-resolved after the InputBlock is modified
+  ib.add("Dog{ speed=12.0; Puppy{ mass=0.2; } } Cat{ mass=0.3; }");
+  assert(mass.get() == 0.2);
+  assert(speed.get() == 12.0);
+  assert(cat.get() == 0.3);
+  ib.add(Option{"g", "-1.6"});
+  assert(g.get() == -1.6);
+  ib.add(InputBlock("Cat", {{"mass", "0.4"}}), true);
+  assert(cat.get() == 0.4);
+  ib = InputBlock("ib", "g=3.7;");
+  assert(g.get() == 3.7 && !mass.get() && !cat.get());
+
+  // nb: blocks must be moved (not copied) when vector of blocks grows
+  static_assert(std::is_nothrow_move_constructible_v<InputBlock>);
+  static_assert(std::is_nothrow_move_assignable_v<InputBlock>);
+
+  // Nested look-ups by string_view
+  const std::string dog = "Dog";
+  const InputBlock ib2("ib2", "Dog{ mass=1.0; }");
+  assert(ib2.get<double>({dog}, "mass") == 1.0);
+}
+
+//******************************************************************************
+void test_snapshot() {
+  using namespace UserIO;
+
+  const std::string input = "a = 1; list = 1,2,3;\n"
+                            "Dog{ mass = 1.0; Puppy{ mass = 0.1; } }\n"
+                            "Cat{ mass = 0.2; } Dog{ speed = 12.0; }";
+  const std::string snapshot = "test.InputBlock.snapshot.tmp";
+  const auto checksum = InputTree::checksum("ib", input);
+  assert(checksum != InputTree::checksum("ib", input + " "));
+  assert(checksum != InputTree::checksum("ib2", input));
+
+  const InputTree tree("ib", input);
+  [[maybe_unused]] const auto written =
+      tree.writeSnapshot(snapshot, checksum);
+  assert(written);
+  const auto loaded = InputTree::loadSnapshot(snapshot, checksum);
+  assert(loaded);
+
+  // Round-trips exactly
+  std::stringstream expected, actual;
+  tree.toInputBlock().print(expected);
+  loaded->toInputBlock().print(actual);
+  assert(expected.str() == actual.str());
+  assert(loaded->root().name() == "ib");
+  assert(loaded->root().get<double>({"Dog"}, "speed") == 12.0);
+  assert(loaded->root().block(0).get<double>({"Puppy"}, "mass") == 0.1);
+  // Data is read from the mapped file, not copied
+  assert(loaded->memory() == 0);
+  // Copies share the mapped file
+  const auto copy = *loaded;
+  assert(copy.root().get<std::vector<int>>("list") ==
+         std::vector<int>({1, 2, 3}));
+  // Overwriting the snapshot replaces the file: existing mappings unaffected
+  [[maybe_unused]] const auto overwritten =
+      InputTree("x", "b = 2;").writeSnapshot(snapshot);
+  assert(overwritten);
+  assert(InputTree::loadSnapshot(snapshot)->root().get<int>("b") == 2);
+  assert(loaded->root().get<double>({"Dog"}, "speed") == 12.0);
+  [[maybe_unused]] const auto rewritten =
+      tree.writeSnapshot(snapshot, checksum);
+  assert(rewritten);
+  // Failure to write is reported
+  [[maybe_unused]] const auto failed =
+      !tree.writeSnapshot("does_not_exist/test.snapshot");
+  assert(failed);
+
+  // Stale or invalid snapshots are rejected
+  assert(!InputTree::loadSnapshot(snapshot, checksum + 1));
+  assert(InputTree::loadSnapshot(snapshot));
+  assert(!InputTree::loadSnapshot("does_not_exist.snapshot"));
+  std::ofstream(snapshot) << input;
+  assert(!InputTree::loadSnapshot(snapshot));
+
+  // Corrupt snapshots (same size) are rejected, or load to a valid tree:
+  // never crash. Each byte in turn is overwritten
+  tree.writeSnapshot(snapshot);
+  const auto good = *read_file(snapshot);
+  for (std::size_t i = 0; i < good.size(); ++i) {
+    for (const char c : {'\xff', '\x7f', '\x01'}) {
+      auto bad = good;
+      bad[i] = c;
+      std::ofstream(snapshot, std::ios::binary) << bad;
+      if (const auto corrupt = InputTree::loadSnapshot(snapshot)) {
+        std::ostringstream os;
+        corrupt->toInputBlock().print(os);
+        corrupt->root().get("zz");
+        corrupt->root().getBlock({"Dog", "Puppy"});
+      }
+    }
+  }
+
+  // Shared children are rejected: here, each block of a chain A{B{C{...}}}
+  // lists every later block as its child (walking it would be exponential).
+  // Layout: 48-byte header, then 24-byte nodes (num_children at offset 20)
+  const auto num_nodes = 40u;
+  std::string chain;
+  for (auto i = 1u; i < num_nodes; ++i)
+    chain += "A{";
+  chain += std::string(num_nodes - 1, '}');
+  InputTree("c", chain).writeSnapshot(snapshot);
+  auto shared = *read_file(snapshot);
+  assert(InputTree::loadSnapshot(snapshot));
+  for (auto k = 0u; k < num_nodes; ++k) {
+    const std::uint32_t num_children = num_nodes - 1 - k;
+    std::memcpy(&shared[48 + 24 * k + 20], &num_children, sizeof(num_children));
+  }
+  std::ofstream(snapshot, std::ios::binary) << shared;
+  assert(!InputTree::loadSnapshot(snapshot));
+
+  // Snapshot as a cache of a parsed file
+  const std::string filename = "test.InputBlock.tmp";
+  std::ofstream(filename) << input;
+  std::remove(snapshot.c_str());
+  const auto parsed = InputTree::fromFileCached("ib", filename, snapshot);
+  assert(parsed.memory() > 0);
+  const auto cached = InputTree::fromFileCached("ib", filename, snapshot);
+  assert(cached.memory() == 0);
+  std::stringstream from_cache;
+  cached.toInputBlock().print(from_cache);
+  assert(from_cache.str() == expected.str());
+  // Input changed: snapshot is stale, so input is re-parsed
+  std::ofstream(filename) << input << "b = 2;";
+  const auto reparsed = InputTree::fromFileCached("ib", filename, snapshot);
+  assert(reparsed.root().get<int>("b") == 2);
+  assert(InputTree::fromFileCached("ib", filename, snapshot).memory() == 0);
+  // Snapshot can't be written: input is still parsed
+  assert(InputTree::fromFileCached("ib", filename, "does_not_exist/snapshot")
+             .root()
+             .get<int>("b") == 2);
+
+  std::remove(filename.c_str());
+  std::remove(snapshot.c_str());
+
+  // Moved trees (with short text stored in-place) remain valid
+  InputTree small("s", "a=1;");
+  InputTree moved = std::move(small);
+  assert(moved.root().get<int>("a") == 1);
+}
+
+//******************************************************************************
+void test_parallel() {
+  using namespace UserIO;
+
+  // Large input, with comments, nesting, and repeated keys/blocks
+  std::string input;
+  for (int i = 0; i < 4000; ++i) {
+    const auto n = std::to_string(i % 100);
+    input += "k" + n + " = " + std::to_string(i) + "; // k" + n + "=-1;\n";
+    input += "Block" + n + " {\n  x = " + std::to_string(i) +
+             "; /* } ; { */\n  Inner { y = " + n + "; }\n}\n";
+    input += "# Block" + n + "{ z=1; }\n";
+    if (i % 1000 == 999)
+      input += "} // unmatched\n";
+  }
+  input += "}\n last = 1;\nUnclosed{ a=1;";
+  assert(input.size() > 4 * 64 * 1024);
+
+  std::stringstream err_serial, err_parallel;
+  auto cerr_buf = std::cerr.rdbuf(err_serial.rdbuf());
+  const InputBlock serial("ib", input);
+  std::cerr.rdbuf(err_parallel.rdbuf());
+  InputBlock parallel("ib");
+  parallel.addParallel(input, 4);
+  std::cerr.rdbuf(cerr_buf);
+
+  std::stringstream expected, actual;
+  serial.print(expected);
+  parallel.print(actual);
+  assert(expected.str() == actual.str());
+  assert(parallel.get<int>("k7") == 3907);
+  assert(parallel.get<int>({"Block7", "Inner"}, "y") == 7);
+  assert(parallel.get<int>("last") == 1);
+  assert(parallel.get<int>({"Unclosed"}, "a") == 1);
+  // Errors are reported at same locations, and in same order, as for serial
+  // parse (sections are parsed on other threads, in any order)
+  const auto errors = err_serial.str();
+  assert(std::count(errors.begin(), errors.end(), '\n') == 6);
+  assert(errors == err_parallel.str());
+
+  // An exception from any section is rethrown, once all are done, and leaves
+  // the block unchanged (sections are parsed using the default resource)
+  struct FailingResource : std::pmr::memory_resource {
+    std::atomic<int> remaining{1000};
+    void *do_allocate(std::size_t bytes, std::size_t align) override {
+      if (--remaining < 0)
+        throw std::bad_alloc();
+      return std::pmr::new_delete_resource()->allocate(bytes, align);
+    }
+    void do_deallocate(void *p, std::size_t bytes,
+                       std::size_t align) override {
+      std::pmr::new_delete_resource()->deallocate(p, bytes, align);
+    }
+    bool do_is_equal(const memory_resource &other) const noexcept override {
+      return this == &other;
+    }
+  } failing;
+  InputBlock unchanged("ib", "a=1;");
+  const auto previous = std::pmr::set_default_resource(&failing);
+  cerr_buf = std::cerr.rdbuf(err_parallel.rdbuf());
+  [[maybe_unused]] bool threw = false;
+  try {
+    unchanged.addParallel(input, 4);
+  } catch (const std::bad_alloc &) {
+    threw = true;
+  }
+  std::cerr.rdbuf(cerr_buf);
+  std::pmr::set_default_resource(previous);
+  assert(threw);
+  assert(unchanged.options().size() == 1 && unchanged.blocks().empty());
+
+  // Merging
+  InputBlock merged("ib"), merged_parallel("ib");
+  cerr_buf = std::cerr.rdbuf(err_serial.rdbuf());
+  merged.add(input, true);
+  merged_parallel.addParallel(input, 3, true);
+  std::cerr.rdbuf(cerr_buf);
+  std::stringstream expected2, actual2;
+  merged.print(expected2);
+  merged_parallel.print(actual2);
+  assert(expected2.str() == actual2.str());
+  assert(merged_parallel.blocks().size() == 101);
+}
+
+//******************************************************************************
+void test_scanner() {
+  using namespace UserIO;
+
+  // SIMD mask matches the lookup table, at every alignment
+  const std::string alphabet = "ab=1.,\r\t\n '\"!#/;{}*";
+  std::string text;
+  for (std::size_t i = 0; i < 1000; ++i)
+    text += alphabet[(i * 7 + i / 13) % alphabet.size()];
+  for (std::size_t i = 0; i + 64 <= text.size(); ++i) {
+    assert(detail::special_mask64(text.data() + i) ==
+           detail::special_mask_scalar(text.data() + i, 64));
+  }
+  const auto is_special = [](char c) {
+    return std::string_view(detail::special_chars, 12).find(c) !=
+           std::string_view::npos;
+  };
+  detail::SpecialScanner scanner(text);
+  for (std::size_t i = 0; i < text.size(); ++i) {
+    const auto expected = std::find_if(text.begin() + long(i), text.end(),
+                                       is_special) -
+                          text.begin();
+    assert(scanner.next(i) == std::size_t(expected));
+  }
+  assert(scanner.next(text.size()) == text.size());
+
+  // Tokens and comments spanning many 64-byte blocks
+  const std::string long_value(200, 'v');
+  const std::string input = "key = " + long_value + ";\n/*" +
+                            std::string(150, '*') + "\n}*/ x=1/2*3;\n//" +
+                            std::string(100, '/') + "\nA{y=2;}}";
+  std::stringstream err;
+  auto cerr_buf = std::cerr.rdbuf(err.rdbuf());
+  const InputBlock ib("ib", input);
+  std::cerr.rdbuf(cerr_buf);
+  assert(ib.get("key") == long_value);
+  assert(ib.get("x") == "1/2*3");
+  assert(ib.get<int>({"A"}, "y") == 2);
+  assert(ib.options().size() == 2);
+  // line numbers still counted inside skipped comments
+  assert(err.str().find("unmatched '}' at 5:8") != std::string::npos);
+}
+
+//******************************************************************************
+void test_events() {
+  using namespace UserIO;
+
+  const std::string input = "a=1; Dog{ mass=1.0; Puppy{ mass=0.1; } }\n"
+                            "Cat{ mass=0.2; } b=2; C{ D{ c=3;";
+
+  // Records every event (void callbacks: never stops)
+  struct Recorder {
+    std::string events;
+    void on_option(std::string_view k, std::string_view v) {
+      events += std::string(k) + '=' + std::string(v) + ';';
+    }
+    void on_block_begin(std::string_view name) {
+      events += std::string(name) + '{';
+    }
+    void on_block_end() { events += '}'; }
+  };
+  Recorder whole, chunked;
+  std::stringstream err;
+  auto cerr_buf = std::cerr.rdbuf(err.rdbuf());
+  assert(parse_input(input, whole));
+  std::istringstream is(input);
+  assert(parse_input(is, chunked, 5));
+  std::cerr.rdbuf(cerr_buf);
+  assert(whole.events == "a=1;Dog{mass=1.0;Puppy{mass=0.1;}}Cat{mass=0.2;}b=2;"
+                         "C{D{c=3;}}");
+  assert(chunked.events == whole.events);
+
+  // Finds a single nested option, then stops
+  struct Finder {
+    std::vector<std::string> path;
+    std::optional<double> mass;
+    int options_seen = 0;
+    bool on_option(std::string_view k, std::string_view v) {
+      ++options_seen;
+      if (path == std::vector<std::string>{"Dog", "Puppy"} && k == "mass") {
+        mass = parse_str_to_T<double>(v);
+        return false;
+      }
+      return true;
+    }
+    void on_block_begin(std::string_view name) { path.emplace_back(name); }
+    void on_block_end() { path.pop_back(); }
+  } finder;
+  std::istringstream is2(input);
+  err.str("");
+  cerr_buf = std::cerr.rdbuf(err.rdbuf());
+  assert(!parse_input(is2, finder, 8));
+  std::cerr.rdbuf(cerr_buf);
+  assert(finder.mass == 0.1);
+  assert(finder.options_seen == 3);
+  assert(finder.path.size() == 2); // no further callbacks after stopping
+  assert(err.str().empty());       // rest of input never lexed
+}
+
+//******************************************************************************
+void test_lazy() {
+  using namespace UserIO;
+
+  std::string input = "a=1; Dog{ mass=1.0; /* } */ Puppy{ mass=0.1; } }\n"
+                      "Cat{ mass=0.2; list=1,2,3; } Dog{ speed=12; }\n";
+  for (int i = 0; i < 50; ++i)
+    input += "B" + std::to_string(i) + "{ x=" + std::to_string(i) + "; }\n";
+
+  // Same content as a fully-parsed block
+  const InputBlock eager("ib", input);
+  const auto lazy = InputBlock::fromStringLazy("ib", input);
+  std::stringstream expected, actual;
+  eager.print(expected);
+  lazy.print(actual);
+  assert(expected.str() == actual.str());
+
+  const auto lazy2 = InputBlock::fromStringLazy("ib", input);
+  assert(lazy2.get<int>("a") == 1);
+  assert(lazy2.get<double>({"Dog"}, "speed") == 12.0);
+  assert(lazy2.get<double>({"Dog", "Puppy"}, "mass") == std::nullopt);
+  assert(lazy2.get<int>({"B42"}, "x") == 42);
+  assert(lazy2.getBlock("Cat")->get<std::vector<int>>("list")->size() == 3);
+  assert(lazy2.blocks().size() == 53);
+  assert(lazy2.blocks().front().blocks().front().get<double>("mass") == 0.1);
+
+  // Copies of unparsed blocks, and concurrent first access
+  const auto lazy3 = InputBlock::fromStringLazy("ib", input);
+  const InputBlock copy = lazy3;
+  std::vector<std::thread> threads;
+  std::atomic<int> sum{0};
+  for (int t = 0; t < 4; ++t) {
+    threads.emplace_back([&] {
+      for (int i = 0; i < 50; ++i)
+        sum += lazy3.get<int>({"B" + std::to_string(i)}, "x").value_or(-1000);
+    });
+  }
+  for (auto &thread : threads)
+    thread.join();
+  assert(sum == 4 * (49 * 50 / 2));
+  assert(copy.get<int>({"B7"}, "x") == 7);
+
+  // Blocks are only parsed (and errors reported) when accessed; locations in
+  // error messages are still relative to the whole input
+  const std::string filename = "test.InputBlock.tmp";
+  std::ofstream(filename) << "a=1;\nA{ b=2;\n  B{ c=3;";
+  std::stringstream err;
+  auto cerr_buf = std::cerr.rdbuf(err.rdbuf());
+  auto from_file = InputBlock::fromFileLazy("f", filename);
+  std::remove(filename.c_str()); // nb: text was copied when read
+  assert(err.str().find("1 unclosed '{'") != std::string::npos);
+  assert(err.str().find("3:4") == std::string::npos);
+  assert(from_file.get<int>({"A", "B"}, "c") == 3);
+  std::cerr.rdbuf(cerr_buf);
+  assert(err.str().find("opened at 3:4") != std::string::npos);
+  from_file.add(Option{"d", "4"});
+  assert(from_file.get<int>("a") == 1 && from_file.get<int>("d") == 4);
+
+  // Editing (here, truncating) the file does not affect unparsed blocks
+  std::ofstream(filename) << "X{ y=1; }";
+  const auto edited = InputBlock::fromFileLazy("f", filename);
+  std::ofstream(filename) << "";
+  assert(edited.get<int>({"X"}, "y") == 1);
+  std::remove(filename.c_str());
+}
+
+//******************************************************************************
+void test_merge() {
+  using namespace UserIO;
+
+  // Order of first appearance kept; options kept in input order (so later
+  // ones still override); nested blocks merged too
+  InputBlock ib("ib");
+  ib.add("A{a=1;} B{b=1;} A{a=2; C{x=1;}} A{a=3; C{y=2;}} B{b=2;}", true);
+  assert(ib.blocks().size() == 2);
+  assert(ib.blocks()[0] == "A" && ib.blocks()[1] == "B");
+  const auto &A = ib.blocks()[0];
+  assert(A.options().size() == 3);
+  assert(A.options()[0].value_str == "1" && A.options()[2].value_str == "3");
+  assert(ib.get<int>({"A"}, "a") == 3);
+  assert(ib.get<int>({"B"}, "b") == 2);
+  assert(A.blocks().size() == 1);
+  assert(ib.get<int>({"A", "C"}, "x") == 1 && ib.get<int>({"A", "C"}, "y") == 2);
+
+  // add(block, merge) also merges nested blocks
+  ib.add(InputBlock("A", "a=4; C{z=3;} D{w=1;}"), true);
+  assert(ib.blocks().size() == 2 && ib.blocks()[0].blocks().size() == 2);
+  assert(ib.get<int>({"A"}, "a") == 4);
+  assert(ib.get<int>({"A", "C"}, "z") == 3 && ib.get<int>({"A", "C"}, "x") == 1);
+  assert(ib.get<int>({"A", "D"}, "w") == 1);
+
+  // Many repeated blocks
+  std::string input;
+  for (int i = 0; i < 5000; ++i) {
+    input += "Block" + std::to_string(i % 50) + "{ x=" + std::to_string(i) +
+             "; Inner{ y=" + std::to_string(i) + "; } }\n";
+  }
+  InputBlock many("many");
+  many.add(input, true);
+  assert(many.blocks().size() == 50);
+  assert(many.blocks()[7].options().size() == 100);
+  assert(many.blocks()[7].blocks().size() == 1);
+  assert(many.get<int>({"Block7"}, "x") == 4957);
+  assert(many.get<int>({"Block7", "Inner"}, "y") == 4957);
+}
+
+//******************************************************************************
+void test_schema() {
+  using namespace UserIO;
+
+  Schema puppy;
+  puppy.option<double>("mass", "Mass, in kg");
+  Schema dog;
+  dog.option<double>("mass", "Mass, in kg")
+      .option<std::vector<int>>("list", "Some integers")
+      .option("name", "Any text")
+      .block("Puppy", puppy, "Young dog")
+      .block("Notes", "Not checked");
+  Schema schema;
+  schema.option<int>("n").option<bool>("flag").block("Dog", dog);
+
+  const InputBlock good("ib", "n=3; flag=yes; Dog{ mass=1.5; list=1,2,3; "
+                              "name=Rex; Puppy{ mass=default; } "
+                              "Notes{ anything=1; } }");
+  assert(schema.validate(good).empty());
+
+  const InputBlock bad("ib", "n=3.5; flg=1; Dog{ mass=heavy; list=1,x; "
+                             "Puppy{ mass=0.1; age=2; } Kitten{} } Cat{}");
+  const auto issues = schema.validate(bad);
+  assert(issues.size() == 7);
+  using IT = Schema::IssueType;
+  assert(issues[0].type == IT::InvalidValue && issues[0].name == "n");
+  assert(issues[1].type == IT::UnknownOption && issues[1].name == "flg");
+  assert(issues[2].type == IT::InvalidValue && issues[2].name == "mass" &&
+         issues[2].value == "heavy" &&
+         issues[2].path == std::vector<std::string>{"Dog"});
+  assert(issues[3].type == IT::InvalidValue && issues[3].name == "list");
+  assert(issues[4].type == IT::UnknownOption && issues[4].name == "age" &&
+         issues[4].path == std::vector<std::string>({"Dog", "Puppy"}));
+  assert(issues[5].type == IT::UnknownBlock && issues[5].name == "Kitten");
+  assert(issues[6].type == IT::UnknownBlock && issues[6].name == "Cat" &&
+         issues[6].path.empty());
+
+  // Warnings, and list of available options, printed to cout
+  std::stringstream out;
+  auto cout_buf = std::cout.rdbuf(out.rdbuf());
+  assert(good.validate(schema));
+  assert(out.str().empty());
+  assert(!bad.validate(schema));
+  std::cout.rdbuf(cout_buf);
+  assert(out.str().find("Could not parse input option in ib/Dog: mass = "
+                        "heavy;") != std::string::npos);
+  assert(out.str().find("Unclear input option in ib/Dog/Puppy: age = 2;") !=
+         std::string::npos);
+  assert(out.str().find("Unclear input block within ib: Cat{}") !=
+         std::string::npos);
+  assert(out.str().find("  Puppy{}  // Young dog\n") != std::string::npos);
+
+  // checkBlock-style list
+  const Schema from_list({{"n", ""}, {"Dog", ""}});
+  assert(from_list.find("n") && from_list.find("Dog") && !from_list.find("x"));
+  assert(from_list.validate(bad).size() == 2); // flg, Cat
+}
+
+//******************************************************************************
+namespace test_structs {
+struct Puppy {
+  double mass = 0.5;
+  std::string name{};
+};
+struct Dog {
+  double mass = 1.0;
+  int legs = 4;
+  bool good = true;
+  std::vector<int> list{};
+  Puppy favourite{};
+  std::vector<Puppy> puppies{};
+};
+} // namespace test_structs
+
+template <> struct UserIO::Binding<test_structs::Puppy> {
+  using P = test_structs::Puppy;
+  static constexpr auto fields =
+      std::make_tuple(UserIO::field("mass", &P::mass, "Mass, in kg"),
+                      UserIO::field("name", &P::name, "Name"));
+};
+template <> struct UserIO::Binding<test_structs::Dog> {
+  using D = test_structs::Dog;
+  static constexpr auto fields = std::make_tuple(
+      UserIO::field("mass", &D::mass, "Mass, in kg"),
+      UserIO::field("legs", &D::legs, "Number of legs"),
+      UserIO::field("good", &D::good, "Good dog?"),
+      UserIO::field("list", &D::list, "Some integers"),
+      UserIO::field("Favourite", &D::favourite, "Favourite puppy"),
+      UserIO::field("Puppy", &D::puppies, "Each puppy"));
+};
+
+void test_binding() {
+  using namespace UserIO;
+  using test_structs::Dog;
+
+  const InputBlock ib("Dog", "mass = 12.5; legs=3; good=no; list=1,2,3;"
+                             "Puppy{ mass=0.1; name=Rex; } Favourite{name=Sam;}"
+                             "Puppy{ name=Fido; } mass=13;");
+  Dog dog;
+  assert(bind(ib, dog));
+  assert(dog.mass == 13.0); // later option overrides
+  assert(dog.legs == 3 && dog.good == false);
+  assert(dog.list == std::vector<int>({1, 2, 3}));
+  assert(dog.favourite.name == "Sam" && dog.favourite.mass == 0.5);
+  assert(dog.puppies.size() == 2);
+  assert(dog.puppies[0].mass == 0.1 && dog.puppies[0].name == "Rex");
+  assert(dog.puppies[1].mass == 0.5 && dog.puppies[1].name == "Fido");
+
+  // Defaults kept; unknown/invalid entries reported by return value
+  const InputBlock bad("Dog", "legs=three; colour=red; Cat{}");
+  const auto dog2 = bind<Dog>(bad);
+  assert(dog2.legs == 4 && dog2.mass == 1.0 && dog2.puppies.empty());
+  Dog dog3;
+  assert(!bind(bad, dog3));
+
+  // Schema/help text from same description
+  const auto schema = bindingSchema<Dog>();
+  assert(schema.validate(ib).empty());
+  assert(schema.validate(bad).size() == 3);
+  assert(schema.find("Puppy")->schema->find("name"));
+  std::stringstream help;
+  schema.printHelp("Dog", help);
+  assert(help.str().find("  legs;  // Number of legs\n") != std::string::npos);
+  assert(help.str().find("  Puppy{}  // Each puppy\n") != std::string::npos);
+  const auto list = bindingList<Dog>();
+  assert(list.size() == 6 && list[0].first == "mass");
+  std::stringstream out;
+  auto cout_buf = std::cout.rdbuf(out.rdbuf());
+  assert(ib.checkBlock(list));
+  // Long lists are hashed: same result
+  auto long_list = list;
+  for (int i = 0; i < 20; ++i)
+    long_list.push_back({"extra" + std::to_string(i), ""});
+  assert(ib.checkBlock(long_list));
+  assert(!bad.checkBlock(long_list) && !bad.checkBlock(list));
+  // checkBlock, getStrict and validate all print the same warnings
+  std::stringstream warnings;
+  Schema::printIssue(Schema::IssueType::UnknownOption, "Dog", "colour", "red",
+                     warnings);
+  Schema::printIssue(Schema::IssueType::UnknownBlock, "Dog", "Cat", "",
+                     warnings);
+  assert(out.str().find(warnings.str()) != std::string::npos);
+  out.str("");
+  bad.validate(bindingSchema<Dog>());
+  assert(out.str().find(warnings.str()) != std::string::npos);
+  out.str("");
+  bad.getStrict<int>("legs");
+  warnings.str("");
+  Schema::printIssue(Schema::IssueType::InvalidValue, "Dog", "legs", "three",
+                     warnings);
+  assert(out.str() == warnings.str());
+  std::cout.rdbuf(cout_buf);
+}
+
+//******************************************************************************
+void test_allocators() {
+  using namespace UserIO;
+
+  // Counts allocations, passing them on to new/delete
+  struct Counting : std::pmr::memory_resource {
+    std::size_t count = 0;
+    void *do_allocate(std::size_t bytes, std::size_t align) override {
+      ++count;
+      return std::pmr::new_delete_resource()->allocate(bytes, align);
+    }
+    void do_deallocate(void *p, std::size_t bytes, std::size_t align) override {
+      std::pmr::new_delete_resource()->deallocate(p, bytes, align);
+    }
+    bool do_is_equal(const std::pmr::memory_resource &o) const noexcept override {
+      return this == &o;
+    }
+  };
+
+  std::string input;
+  for (int i = 0; i < 200; ++i)
+    input += "B" + std::to_string(i) + "{ x=" + std::to_string(i) + "; }\n";
+
+  // Entire parse (including scratch space) comes from the arena
+  Counting upstream, default_resource;
+  {
+    std::pmr::monotonic_buffer_resource arena(&upstream);
+    const auto old_default = std::pmr::set_default_resource(&default_resource);
+    InputTree tree("tree", input, &arena);
+    std::pmr::set_default_resource(old_default);
+    assert(upstream.count > 0 && default_resource.count == 0);
+    const auto moved = std::move(tree); // keeps arena
+    assert(moved.root().get<int>({"B150"}, "x") == 150);
+    const InputTree copy = moved; // default resource
+    assert(copy.root().get<int>({"B199"}, "x") == 199);
+  }
+
+  // Same for InputBlock: every node, option and string is in the arena
+  // (strings are long enough not to be stored in-place)
+  std::string long_input;
+  for (int i = 0; i < 200; ++i) {
+    const auto n = std::to_string(i);
+    long_input += "Block_with_a_long_name_" + n + "{ option_with_a_long_key_" +
+                  n + " = value_that_is_long_" + n + "; Inner{ x = " + n +
+                  "; } }\n";
+  }
+  upstream.count = 0;
+  for (const auto lazy : {false, true}) {
+    std::pmr::monotonic_buffer_resource arena(&upstream);
+    const auto old_default = std::pmr::set_default_resource(&default_resource);
+    {
+      auto ib = lazy ? InputBlock::fromStringLazy("ib", long_input, &arena)
+                     : InputBlock("ib", long_input, &arena);
+      assert(ib.get_allocator().resource() == &arena);
+      assert(ib.get<int>({"Block_with_a_long_name_150", "Inner"}, "x") == 150);
+      ib.add(Option("option_added_later_with_long_key", "1", &arena));
+      ib.add("Block_with_a_long_name_7{ y = 2; }", true); // merges blocks
+      assert(ib.get<int>({"Block_with_a_long_name_7"}, "y") == 2);
+      // Moves keep the arena
+      const auto moved = std::move(ib);
+      assert(moved.get<int>("option_added_later_with_long_key") == 1);
+    }
+    std::pmr::set_default_resource(old_default);
+    assert(upstream.count > 0 && default_resource.count == 0);
+  }
+  {
+    // Copies use the default resource, or the one given
+    std::pmr::monotonic_buffer_resource arena(&upstream);
+    const InputBlock ib("ib", input, &arena);
+    const InputBlock copy = ib;
+    assert(copy.get_allocator().resource() == std::pmr::get_default_resource());
+    const InputBlock copy2(ib, &arena);
+    assert(copy2.get_allocator().resource() == &arena);
+    assert(copy2 == ib && copy == ib);
+  }
+
+  // Move-aware add: rvalues moved in, lvalues copied
+  InputBlock ib("ib");
+  InputBlock block("A", {{"a", "1"}});
+  ib.add(block);
+  assert(block.options().size() == 1);
+  Option option{"k", std::string(100, 'v')};
+  const auto data = option.value_str.data();
+  ib.add(std::move(option));
+  assert(ib.findOption("k")->value_str.data() == data);
+  std::vector<Option> options{{"x", "1"}, {"y", "2"}};
+  ib.add(std::move(options));
+  ib.add(std::move(block));
+  assert(ib.blocks().size() == 2 && ib.options().size() == 3);
+
+  // Moving into a block with a different resource keeps this block's
+  {
+    std::pmr::monotonic_buffer_resource arena(&upstream);
+    InputBlock in_arena(&arena);
+    in_arena = InputBlock("ib", long_input);
+    assert(in_arena.get_allocator().resource() == &arena);
+    assert(in_arena.blocks().size() == 200);
+  }
+
+  // Converting to std::string/std::vector (see README.md: 2.0 changes)
+  const std::string value(ib.getOption("k")->value_str);
+  const std::vector<Option> as_vector(ib.options().begin(),
+                                      ib.options().end());
+  const std::vector<InputBlock> blocks(ib.blocks().begin(), ib.blocks().end());
+  assert(value.size() == 100 && as_vector.size() == 3 && blocks.size() == 2);
+}
+
+//******************************************************************************
+void test_telemetry() {
+#if defined(USERIO_TELEMETRY)
+  using namespace UserIO;
+  InputBlock ib("ib", "a = 1; b = 2; unused = 3; Dog{ mass = 5; Puppy{ x=1; } }");
+  assert(ib.get<int>("a") == 1);
+  assert(ib.get<int>("a") == 1);
+  assert(ib.get("missing", 7) == 7);
+  assert(ib.get<int>({"Dog"}, "mass") == 5);
+  assert(!ib.getBlock("Cat"));
+  assert(ib.findOption("b") != nullptr);
+
+  const auto stats = ib.accessStats();
+  const auto find = [&](const std::string &path) {
+    const auto it =
+        std::find_if(stats.begin(), stats.end(),
+                     [&](const auto &stat) { return stat.path == path; });
+    assert(it != stats.end());
+    return *it;
+  };
+  assert(find("a").found && find("a").count == 2);
+  assert(find("b").count == 1 && find("unused").count == 0);
+  assert(!find("missing").found && find("missing").count == 1);
+  assert(!find("Cat{}").found && find("Cat{}").count == 1);
+  assert(find("Dog{}").count == 1 && find("Dog/mass").count == 1);
+  assert(find("Dog/Puppy{}").count == 0);
+
+  const auto unused = ib.unusedOptions();
+  assert((unused == std::vector<std::string>{"unused", "Dog/Puppy/x"}));
+
+  std::ostringstream report;
+  report << std::scientific << std::setprecision(3);
+  [[maybe_unused]] const auto flags = report.flags();
+  ib.printAccessReport(report);
+  assert(report.str().find("Dog/Puppy/x") != std::string::npos);
+  // Caller's formatting is left as it was
+  assert(report.flags() == flags && report.precision() == 3);
+
+  // Unparsed lazy blocks are not parsed by the report
+  const auto lazy = InputBlock::fromStringLazy("lazy", "k = 1; B{ x = 2; }");
+  assert(lazy.accessStats().size() == 2); // "k", "B{}"
+  assert(lazy.findBlock("B")->options().size() == 1);
+  assert(lazy.accessStats().size() == 3);
+#endif
+}
+
+//******************************************************************************
+void test_tracing() {
+  using namespace UserIO;
+  struct Collect : ParseTracer {
+    std::vector<ParsePhase> phases;
+    void onPhase(const ParsePhase &phase) override { phases.push_back(phase); }
+    std::vector<std::string> names() const {
+      std::vector<std::string> out;
+      for (const auto &phase : phases)
+        out.push_back(phase.name);
+      return out;
+    }
+  };
+  using Names = std::vector<std::string>;
+  const std::string input = "a = 1; // comment\nB{ x=1; } B{ y=2; C{ z=3; } }";
+
+  // No tracer installed: nothing reported
+  Collect tracer;
+  InputBlock untraced("ib", input);
+  assert(tracer.phases.empty());
+
+  {
+    ScopedParseTracer scope(tracer);
+    InputBlock ib("ib");
+    ib.add(input, true);
+    assert((tracer.names() == Names{"parse", "consolidate"}));
+    const auto &parse = tracer.phases[0];
+    assert(parse.bytes_in == input.size() && parse.bytes_out == 0);
+    assert(parse.nodes_in == 0 && parse.nodes_out == 7);
+    assert(parse.memory > 0 && parse.seconds >= 0.0);
+    const auto &consolidate = tracer.phases[1];
+    assert(consolidate.nodes_in == 7 && consolidate.nodes_out == 6);
+
+    // Nested tracers: inner one replaces outer until destroyed
+    Collect inner;
+    {
+      ScopedParseTracer inner_scope(inner);
+      InputTree tree("tree", input);
+      assert((inner.names() == Names{"parse"}));
+      assert(inner.phases[0].nodes_out == 7); // excludes root block
+    }
+    assert(tracer.phases.size() == 2);
+
+    const std::string filename = "test.InputBlock.tmp";
+    std::ofstream(filename) << input;
+    tracer.phases.clear();
+    const auto file = InputBlock::fromFile("ib", filename);
+    assert((tracer.names() == Names{"read", "parse"}));
+    assert(tracer.phases[0].bytes_in == input.size());
+    tracer.phases.clear();
+    const auto stream = InputBlock("ib", std::ifstream(filename));
+    assert((tracer.names() == Names{"parse"}));
+    assert(tracer.phases[0].bytes_in == input.size());
+    std::remove(filename.c_str());
+
+    tracer.phases.clear();
+    const auto lazy = InputBlock::fromStringLazy("lazy", input);
+    assert((tracer.names() == Names{"parse"}));
+    assert(lazy.findBlock("B")->findOption("y"));
+    assert((tracer.names() == Names{"parse", "materialize"}));
+
+    std::string big;
+    for (int i = 0; i < 20000; ++i)
+      big += "B" + std::to_string(i % 10) + "{ x = " + std::to_string(i) + "; }\n";
+    tracer.phases.clear();
+    InputBlock parallel("ib");
+    parallel.addParallel(big, 4, true);
+    assert((tracer.names() == Names{"parse_sections", "join", "consolidate"}));
+    assert(tracer.phases[0].bytes_in == big.size());
+    assert(tracer.phases[1].nodes_out == 40000);
+    assert(tracer.phases[2].nodes_out == 20010);
+  }
+  InputBlock after("ib", input);
+  assert(tracer.phases.size() == 3);
+
+  // Built-in sink
+  std::ostringstream text, json;
+  {
+    StreamTracer text_tracer(text);
+    ScopedParseTracer scope(text_tracer);
+    InputBlock ib("ib", input);
+  }
+  {
+    StreamTracer json_tracer(json, StreamTracer::Format::Json);
+    ScopedParseTracer scope(json_tracer);
+    InputBlock ib("ib", input);
+  }
+  assert(text.str().rfind("parse", 0) == 0);
+  assert(json.str().rfind("{\"phase\": \"parse\", \"seconds\": ", 0) == 0);
+  assert(json.str().find("\"nodes_out\": 7, ") != std::string::npos);
+}
+
+//******************************************************************************
+void test_serialize() {
+  using namespace UserIO;
+  const std::string input = "a=1; e; B{ x=1; } C{ } D{ y; } "
+                            "E{ p=1; q=2; F{ G{ z=3; } H{} } } b=2;";
+  const InputBlock ib("ib", input);
+
+  // Pretty: exactly as print()
+  const std::string expected = "a = 1;\n"
+                               "e;\n"
+                               "b = 2;\n"
+                               "B { x = 1; }\n"
+                               "C { }\n"
+                               "D { y; }\n"
+                               "E { \n"
+                               "  p = 1;\n"
+                               "  q = 2;\n"
+                               "  F { \n"
+                               "    G { z = 3; }\n"
+                               "    H { }\n"
+                               "  }\n"
+                               "}\n";
+  assert(ib.serialize() == expected);
+  std::ostringstream printed;
+  ib.print(printed);
+  assert(printed.str() == expected);
+  std::ostringstream nested;
+  ib.findBlock("E")->print(nested, 2);
+  assert(nested.str() == "  E { \n    p = 1;\n    q = 2;\n    F { \n"
+                         "      G { z = 3; }\n      H { }\n    }\n  }\n");
+  assert(InputBlock("one", "a=1;").serialize() == "a = 1; ");
+
+  // Minified: no optional spaces; parses back to the same
+  const auto minified = ib.serialize(InputBlock::Layout::Minified);
+  assert(minified == "a=1;e;b=2;B{x=1;}C{}D{y;}E{p=1;q=2;F{G{z=3;}H{}}}");
+  assert(InputBlock("ib", minified).serialize() == expected);
+
+  // Appends to existing buffer
+  std::string buffer = "// header\n";
+  ib.serialize(buffer);
+  assert(buffer == "// header\n" + expected);
+
+  // Sink: written in chunks, same result
+  std::string big;
+  for (int i = 0; i < 2000; ++i)
+    big += "Block" + std::to_string(i) + "{ key = " + std::to_string(i) + "; }";
+  const InputBlock large("large", big);
+  std::string from_sink;
+  std::size_t chunks = 0;
+  large.serialize(
+      [&](std::string_view chunk) {
+        assert(chunk.size() <= 1024);
+        from_sink.append(chunk);
+        ++chunks;
+      },
+      InputBlock::Layout::Pretty, 1024);
+  assert(chunks > 1 && from_sink == large.serialize());
+
+  // Lazy blocks are parsed as they are written
+  const auto lazy = InputBlock::fromStringLazy("lazy", input);
+  assert(lazy.serialize() == expected);
+}
+
+//******************************************************************************
+void test_hash_diff() {
+  using namespace UserIO;
+  const std::string input = "a=1; b=2; Dog{ mass=5; Puppy{ mass=1; } } Cat{ x=1; }";
+  const InputBlock ib("ib", input);
+  assert(ib.hash() == InputBlock("ib", input).hash());
+  assert(ib == InputBlock("ib", input));
+  assert(ib != InputBlock("other", input));
+  assert(ib != InputBlock("ib", "b=2; a=1; Dog{ mass=5; Puppy{ mass=1; } } Cat{ x=1; }"));
+  assert(ib != InputBlock("ib", "a=1; b=2; Dog{ mass=5; Puppy{ mass=2; } } Cat{ x=1; }"));
+  assert(ib != InputBlock("ib", "a=1; b=2; Dog{ mass=5; Puppy{ mass=1; } }"));
+  assert(InputBlock("ib", "a=1;") != InputBlock("ib", "A{ a=1; }"));
+  assert(InputBlock("ib", "a;") != InputBlock("ib", "a=;b;"));
+
+  // Kept up to date as options/blocks are added (any way), and on copy
+  InputBlock grown("ib", "a=1;");
+  const auto h0 = grown.hash();
+  grown.add(std::string("b=2;"));
+  assert(grown.hash() != h0);
+  grown.add("Dog{ mass=5; Puppy{ mass=1; } } Cat{ x=1; }");
+  assert(grown.hash() == ib.hash() && grown == ib);
+  grown.add(InputBlock("Dog", {{"speed", "12"}}), true);
+  grown.add(std::string("Dog{ Puppy{ speed=3; } }"), true);
+  InputBlock fresh("ib");
+  fresh.add(input + "Dog{ speed=12; Puppy{ speed=3; } }", true);
+  assert(grown.hash() == fresh.hash() && grown == fresh);
+  const auto copy = grown;
+  assert(copy.hash() == grown.hash());
+  InputBlock added("ib");
+  added.add(Option{"a", "1"});
+  added.add(std::vector<Option>{{"b", "2"}});
+  added.add(*ib.findBlock("Dog"));
+  added.add(*ib.findBlock("Cat"));
+  assert(added == ib);
+
+  // Lazy blocks: same hash as eager
+  assert(InputBlock::fromStringLazy("ib", input).hash() == ib.hash());
+
+  // diff: options compared by effective value; blocks matched by name
+  const InputBlock changed(
+      "ib", "a=1; a=3; c=4; Dog{ mass=5; Puppy{ mass=2; } } Bird{ y=1; }");
+  const auto changes = ib.diff(changed);
+  using Path = std::vector<std::string>;
+  assert(changes.size() == 6);
+  const auto has = [&](InputBlock::ChangeType type, const Path &path,
+                       const std::string &name, const std::string &old_value,
+                       const std::string &new_value) {
+    return std::any_of(changes.begin(), changes.end(), [&](const auto &c) {
+      return c.type == type && c.path == path && c.name == name &&
+             c.old_value == old_value && c.new_value == new_value;
+    });
+  };
+  using Type = InputBlock::ChangeType;
+  assert(has(Type::Changed, {}, "a", "1", "3"));
+  assert(has(Type::Removed, {}, "b", "2", ""));
+  assert(has(Type::Added, {}, "c", "", "4"));
+  assert(has(Type::Changed, Path{"Dog", "Puppy"}, "mass", "1", "2"));
+  assert(has(Type::Removed, {}, "Cat", "", ""));
+  assert(has(Type::Added, {}, "Bird", "", ""));
+  assert(ib.diff(ib).empty() && ib.diff(InputBlock("ib", input)).empty());
+
+  // Repeated blocks: n-th matched with n-th
+  const auto repeated = InputBlock("ib", "B{ x=1; } B{ x=2; }")
+                            .diff(InputBlock("ib", "B{ x=1; } B{ x=3; } B{}"));
+  assert(repeated.size() == 2);
+  assert(repeated[0].type == Type::Changed && repeated[0].path == Path{"B"});
+  assert(repeated[1].type == Type::Added && repeated[1].is_block);
+}
+
+//******************************************************************************
+void test_watcher() {
+  using namespace UserIO;
+  const std::string filename = "test.InputBlock.watch.tmp";
+  std::ofstream(filename) << "a=1; Solver{ tol=1e-6; } Output{ file=out; }";
+  InputWatcher input("params", filename);
+  const auto first = input.snapshot();
+  assert(first->get<double>({"Solver"}, "tol") == 1e-6);
+
+  std::vector<InputWatcher::Changes> all, solver;
+  input.subscribe([&](const auto &, const auto &changes) {
+    all.push_back(changes);
+  });
+  input.subscribe(
+      [&](const auto &snapshot, const auto &changes) {
+        assert(snapshot->template get<double>({"Solver"}, "tol") == 1e-8);
+        solver.push_back(changes);
+      },
+      {"Solver"});
+
+  // nb: reload() called outside assert (so that it runs with NDEBUG)
+  [[maybe_unused]] bool reloaded = false;
+
+  // Not modified: nothing re-read
+  reloaded = input.reload();
+  assert(!reloaded && input.snapshot() == first);
+
+  // Only comments changed: no new snapshot
+  std::ofstream(filename) << "// comment\na=1; Solver{ tol=1e-6; } Output{ file=out; }";
+  reloaded = input.reload();
+  assert(!reloaded && input.snapshot() == first);
+
+  std::ofstream(filename) << "a=1; Solver{ tol=1e-8; } Output{ file=out2; }";
+  reloaded = input.reload();
+  assert(reloaded);
+  const auto second = input.snapshot();
+  assert(second != first && second->get<double>({"Solver"}, "tol") == 1e-8);
+  assert(first->get<double>({"Solver"}, "tol") == 1e-6); // unchanged
+  assert(all.size() == 1 && all[0].size() == 2);
+  assert(solver.size() == 1 && solver[0].size() == 1);
+  assert(solver[0][0].name == "tol" && solver[0][0].new_value == "1e-8");
+
+  // File exists but cannot be read: current input kept, nobody notified
+  std::ofstream(filename) << "a=1; Solver{ tol=1e-9; } Output{ file=out3; }";
+  std::filesystem::permissions(filename, std::filesystem::perms::none);
+  if (!std::ifstream(filename)) { // nb: root can read it anyway
+    reloaded = input.reload();
+    assert(!reloaded && input.snapshot() == second);
+    assert(all.size() == 1 && solver.size() == 1);
+  }
+  std::filesystem::permissions(filename, std::filesystem::perms::owner_read |
+                                             std::filesystem::perms::owner_write);
+  std::ofstream(filename) << "a=1; Solver{ tol=1e-8; } Output{ file=out2; }";
+  reloaded = input.reload();
+  assert(!reloaded && input.snapshot() == second);
+
+  // Missing file: current input kept
+  std::remove(filename.c_str());
+  reloaded = input.reload();
+  assert(!reloaded && input.snapshot() == second);
+
+  // Watching: reloaded as soon as file changes (or within poll interval)
+  std::mutex mutex;
+  std::condition_variable changed;
+  std::size_t notifications = 0;
+  input.subscribe([&](const auto &, const auto &) {
+    const std::lock_guard<std::mutex> lock(mutex);
+    ++notifications;
+    changed.notify_all();
+  });
+  input.watch(std::chrono::milliseconds(20));
+  std::ofstream(filename) << "a=2; Solver{ tol=1e-8; } Output{ file=out2; }";
+  {
+    std::unique_lock<std::mutex> lock(mutex);
+    changed.wait_for(lock, std::chrono::seconds(5),
+                     [&] { return notifications > 0; });
+  }
+  input.stop();
+  assert(notifications == 1 && input.snapshot()->get<int>("a") == 2);
+  std::remove(filename.c_str());
+}